@@ -0,0 +1,118 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "grpc_mock_server_binary_mock.h"
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+
+#include <limits>
+#include <string>
+
+namespace grpc_mock_server {
+
+bool isBinaryMock(std::string_view data) {
+    return data.starts_with(kBinaryMockMagic);
+}
+
+auto readBinaryMock(std::string_view data) -> std::optional<BinaryMock> {
+    if (!isBinaryMock(data) || data.size() > static_cast<std::size_t>(std::numeric_limits<int>::max())) {
+        return std::nullopt;
+    }
+
+    google::protobuf::io::CodedInputStream input(reinterpret_cast<const std::uint8_t*>(data.data()), static_cast<int>(data.size()));
+    // Sizes are compared unsigned: a varint of 2^31 or more must not turn negative and pass the check
+    auto remaining = [&] {
+        return data.size() - static_cast<std::size_t>(input.CurrentPosition());
+    };
+    // Takes the next size bytes of the data, nullopt if the data ends earlier
+    auto take = [&](std::uint32_t size) -> std::optional<std::string_view> {
+        if (size > remaining()) {
+            return std::nullopt;
+        }
+        auto result = data.substr(static_cast<std::size_t>(input.CurrentPosition()), size);
+        if (!input.Skip(static_cast<int>(size))) {
+            return std::nullopt;
+        }
+        return result;
+    };
+
+    std::uint32_t version = 0;
+    std::uint32_t type_name_size = 0;
+    if (!input.Skip(static_cast<int>(kBinaryMockMagic.size())) || !input.ReadLittleEndian32(&version)
+        || version != kBinaryMockVersion || !input.ReadVarint32(&type_name_size) || type_name_size == 0) {
+        return std::nullopt;
+    }
+    auto type_name = take(type_name_size);
+    if (!type_name.has_value()) {
+        return std::nullopt;
+    }
+
+    BinaryMock result;
+    result.m_type_name = type_name.value();
+    while (!input.ExpectAtEnd()) {
+        std::uint32_t message_size = 0;
+        if (!input.ReadVarint32(&message_size)) {
+            return std::nullopt;
+        }
+        auto message = take(message_size);
+        if (!message.has_value()) {
+            return std::nullopt;
+        }
+        result.m_messages.push_back(message.value());
+    }
+    return result;
+}
+
+bool writeBinaryMock(std::ostream& output, const std::vector<const google::protobuf::Message*>& messages) {
+    if (messages.empty()) {
+        return false;
+    }
+
+    const auto* descriptor = messages.front()->GetDescriptor();
+    {
+        google::protobuf::io::OstreamOutputStream output_stream(&output);
+        google::protobuf::io::CodedOutputStream coded_output(&output_stream);
+        coded_output.WriteRaw(kBinaryMockMagic.data(), static_cast<int>(kBinaryMockMagic.size()));
+        coded_output.WriteLittleEndian32(kBinaryMockVersion);
+        coded_output.WriteVarint32(static_cast<std::uint32_t>(descriptor->full_name().size()));
+        coded_output.WriteString(descriptor->full_name());
+
+        for (const auto* message : messages) {
+            if (message->GetDescriptor() != descriptor) {
+                return false;
+            }
+            auto message_size = message->ByteSizeLong();
+            if (message_size > static_cast<std::size_t>(std::numeric_limits<int>::max())) {
+                return false;
+            }
+            coded_output.WriteVarint32(static_cast<std::uint32_t>(message_size));
+            if (!message->SerializeToCodedStream(&coded_output)) {
+                return false;
+            }
+        }
+        if (coded_output.HadError()) {
+            return false;
+        }
+    }
+    return static_cast<bool>(output);
+}
+
+} // grpc_mock_server
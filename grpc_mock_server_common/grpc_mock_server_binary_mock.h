@@ -0,0 +1,60 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef GRPC_MOCK_SERVER_BINARY_MOCK_H
+#define GRPC_MOCK_SERVER_BINARY_MOCK_H
+
+#include "grpc_mock_server_export.h"
+
+#include <google/protobuf/message.h>
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace grpc_mock_server {
+
+// Binary mock file (".binpb"), the wire format counterpart of the JSON responses:
+//
+//     "GMSB" | version: fixed32 | type name size: varint | full type name | { message size: varint | serialized message }*
+//
+// Files are recognized by the magic, so a full response path may point to either format
+constexpr std::string_view kBinaryMockMagic = "GMSB";
+constexpr std::uint32_t kBinaryMockVersion = 1;
+constexpr std::string_view kBinaryMockExtension = ".binpb";
+
+// Views into the file data
+struct GRPC_MOCK_SERVER_LIBRARY_API BinaryMock {
+    std::string_view m_type_name;
+    std::vector<std::string_view> m_messages;
+};
+
+GRPC_MOCK_SERVER_LIBRARY_API bool isBinaryMock(std::string_view data);
+
+// nullopt if the header or a message size is invalid; messages are not parsed
+GRPC_MOCK_SERVER_LIBRARY_API auto readBinaryMock(std::string_view data) -> std::optional<BinaryMock>;
+
+// Messages must be of the same type, at least one is required
+GRPC_MOCK_SERVER_LIBRARY_API bool writeBinaryMock(std::ostream& output, const std::vector<const google::protobuf::Message*>& messages);
+
+} // grpc_mock_server
+
+#endif // GRPC_MOCK_SERVER_BINARY_MOCK_H
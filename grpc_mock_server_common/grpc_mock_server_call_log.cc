@@ -0,0 +1,115 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "grpc_mock_server_call_log.h"
+#include "grpc_mock_server_metrics.h"
+
+#include <cassert>
+
+CallLog::CallLog(Callback callback, std::size_t queue_size, spdlog::async_overflow_policy overflow_policy)
+    : CallLog(
+        kTraceCallback,
+        TraceCallback([callback = std::move(callback)](const CallTrace& trace) {
+            callback(trace.m_time, trace.m_method, trace.m_request.json(), trace.m_status, trace.m_response.json());
+        }),
+        queue_size,
+        overflow_policy
+    ) {
+}
+
+CallLog::CallLog(TraceCallbackTag, TraceCallback callback, std::size_t queue_size, spdlog::async_overflow_policy overflow_policy)
+    : m_callback(std::move(callback)), m_overflow_policy(overflow_policy), m_records(queue_size) {
+    assert(queue_size > 0);
+    m_thread = std::jthread([this](std::stop_token stop_token) { run(stop_token); });
+}
+
+CallLog::~CallLog() {
+    m_thread.request_stop();
+    m_thread.join();
+}
+
+void CallLog::push(
+    time_t time,
+    std::string method,
+    std::shared_ptr<const google::protobuf::Message> request,
+    int status,
+    std::shared_ptr<const google::protobuf::Message> response
+) {
+    push(CallTrace(time, std::move(method), LazyMessageJson(std::move(request)), status, LazyMessageJson(std::move(response))));
+}
+
+void CallLog::push(CallTrace trace) {
+    {
+        std::unique_lock lock(m_mutex);
+        if (m_count == m_records.size()) {
+            if (m_overflow_policy == spdlog::async_overflow_policy::block) {
+                m_not_full.wait(lock, [this] { return m_count < m_records.size(); });
+            }
+            else {
+                m_head = (m_head + 1) % m_records.size();
+                m_count--;
+                m_dropped_count++;
+            }
+        }
+
+        m_records[(m_head + m_count) % m_records.size()] = std::move(trace);
+        m_count++;
+    }
+    m_not_empty.notify_one();
+}
+
+void CallLog::flush() {
+    std::unique_lock lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_count == 0 && !m_processing; });
+}
+
+std::uint64_t CallLog::droppedCount() {
+    std::lock_guard lock(m_mutex);
+    return m_dropped_count;
+}
+
+void CallLog::run(std::stop_token stop_token) {
+    std::unique_lock lock(m_mutex);
+    while (true) {
+        // Stop only when the queue is drained
+        m_not_empty.wait(lock, stop_token, [this] { return m_count > 0; });
+        if (m_count == 0) {
+            break;
+        }
+
+        auto record = std::move(m_records[m_head]);
+        m_head = (m_head + 1) % m_records.size();
+        m_count--;
+        m_processing = true;
+        lock.unlock();
+        m_not_full.notify_one();
+
+        {
+            StageTimer log_timer(record.m_metrics, MethodMetrics::Stage::log);
+            m_callback(record);
+        }
+        record = CallTrace();
+
+        lock.lock();
+        m_processing = false;
+        if (m_count == 0) {
+            m_idle.notify_all();
+        }
+    }
+}
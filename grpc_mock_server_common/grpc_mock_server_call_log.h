@@ -0,0 +1,118 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef GRPC_MOCK_SERVER_CALL_LOG_H
+#define GRPC_MOCK_SERVER_CALL_LOG_H
+
+#include "grpc_mock_server_export.h"
+#include "grpc_mock_server_trace.h"
+
+#include <google/protobuf/message.h>
+#include <spdlog/async_logger.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Passes the method calls to the callback (e.g. grpcMockServerMethodCallback()) on a separate thread.
+// RPC threads only enqueue the messages, JSON is rendered on the logging thread:
+//
+//     CallLog call_log(grpcMockServerMethodCallback);
+//     call_log.push(current_unix_time(), "/routeguide.RouteGuide/GetFeature", LazyMessageJson::copyMessage(*request), 0, response);
+//
+// A TraceCallback receives the CallTrace itself and renders JSON only for the calls it actually writes:
+//
+//     CallLog call_log(CallLog::kTraceCallback, [](const CallTrace& trace) { ... });
+//
+// The queue is bounded, when it is full push() either waits or drops the oldest call depending on the overflow policy
+class GRPC_MOCK_SERVER_LIBRARY_API CallLog {
+public:
+    using Callback = std::function<void(
+        time_t time,
+        const std::string& method,
+        const std::string& request_json,
+        int status,
+        const std::string& response_json
+    )>;
+    using TraceCallback = std::function<void(const CallTrace& trace)>;
+    // Selects the TraceCallback constructor; overloading on the std::function types alone makes generic lambdas ambiguous
+    struct TraceCallbackTag {};
+    static constexpr TraceCallbackTag kTraceCallback{};
+
+private:
+    TraceCallback m_callback;
+    spdlog::async_overflow_policy m_overflow_policy;
+
+    std::mutex m_mutex;
+    std::condition_variable_any m_not_empty;
+    std::condition_variable m_not_full;
+    std::condition_variable m_idle;
+    // Ring buffer of m_records.size() calls
+    std::vector<CallTrace> m_records;
+    std::size_t m_head = 0;
+    std::size_t m_count = 0;
+    bool m_processing = false;
+    std::uint64_t m_dropped_count = 0;
+
+    std::jthread m_thread;
+
+public:
+    explicit CallLog(
+        Callback callback,
+        std::size_t queue_size = 8192,
+        spdlog::async_overflow_policy overflow_policy = spdlog::async_overflow_policy::block
+    );
+    CallLog(
+        TraceCallbackTag,
+        TraceCallback callback,
+        std::size_t queue_size = 8192,
+        spdlog::async_overflow_policy overflow_policy = spdlog::async_overflow_policy::block
+    );
+    // Calls already in the queue are passed to the callback before the thread stops
+    ~CallLog();
+
+    // Messages are not copied: they must not be modified after the call, see LazyMessageJson::copyMessage()
+    void push(
+        time_t time,
+        std::string method,
+        std::shared_ptr<const google::protobuf::Message> request,
+        int status,
+        std::shared_ptr<const google::protobuf::Message> response
+    );
+    void push(CallTrace trace);
+
+    // Wait until every queued call is passed to the callback
+    void flush();
+    std::uint64_t droppedCount();
+
+private:
+    void run(std::stop_token stop_token);
+
+    CallLog(const CallLog& root) = delete;
+    CallLog& operator=(const CallLog&) = delete;
+};
+
+#endif // GRPC_MOCK_SERVER_CALL_LOG_H
@@ -0,0 +1,80 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "grpc_mock_server_channel_pool.h"
+
+#include <grpcpp/create_channel.h>
+#include <grpcpp/support/channel_arguments.h>
+
+#include <cassert>
+
+ChannelPool::ChannelPool(std::string target, std::shared_ptr<grpc::ChannelCredentials> credentials, const Settings& settings)
+    : m_target(std::move(target)), m_next(0) {
+    assert(settings.channel_count > 0);
+
+    m_entries.reserve(settings.channel_count);
+    for (std::size_t i = 0; i < settings.channel_count; i++) {
+        grpc::ChannelArguments arguments;
+        // Channels with the same arguments would share the subchannel and so the connection
+        arguments.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+        arguments.SetInt("grpc_mock_server.channel_index", static_cast<int>(i));
+        if (settings.keepalive_time.has_value()) {
+            arguments.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS, static_cast<int>(settings.keepalive_time->count()));
+            arguments.SetInt(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, static_cast<int>(settings.keepalive_timeout.count()));
+            arguments.SetInt(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, settings.keepalive_permit_without_calls ? 1 : 0);
+        }
+        if (settings.max_receive_message_size.has_value()) {
+            arguments.SetMaxReceiveMessageSize(settings.max_receive_message_size.value());
+        }
+
+        auto channel = grpc::CreateCustomChannel(m_target, credentials, arguments);
+        auto stub = std::make_unique<grpc::GenericStub>(channel);
+        m_entries.push_back(Entry(std::move(channel), std::move(stub)));
+    }
+}
+
+auto ChannelPool::fromConfig(const ConfigSnapshot& config) -> std::shared_ptr<ChannelPool> {
+    return fromConfig(config, Settings());
+}
+
+auto ChannelPool::fromConfig(const ConfigSnapshot& config, const Settings& settings) -> std::shared_ptr<ChannelPool> {
+    if (!config.haveRemoteHostUrl() || !config.haveRemoteHostPort()) {
+        return nullptr;
+    }
+    auto target = config.remoteHostUrl() + ":" + std::to_string(config.remoteHostPort());
+    return std::make_shared<ChannelPool>(std::move(target), grpc::InsecureChannelCredentials(), settings);
+}
+
+auto ChannelPool::stub() -> grpc::GenericStub& {
+    auto index = m_next.fetch_add(1, std::memory_order_relaxed) % m_entries.size();
+    return *m_entries[index].m_stub;
+}
+
+auto ChannelPool::channel(std::size_t index) const -> const std::shared_ptr<grpc::Channel>& {
+    assert(index < m_entries.size());
+    return m_entries[index].m_channel;
+}
+
+std::size_t ChannelPool::size() const {
+    return m_entries.size();
+}
+
+const std::string& ChannelPool::target() const {
+    return m_target;
+}
@@ -0,0 +1,85 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef GRPC_MOCK_SERVER_CHANNEL_POOL_H
+#define GRPC_MOCK_SERVER_CHANNEL_POOL_H
+
+#include "grpc_mock_server_export.h"
+#include "grpc_mock_server_configuration.h"
+
+#include <grpcpp/channel.h>
+#include <grpcpp/generic/generic_stub.h>
+#include <grpcpp/security/credentials.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Channels to a single upstream target with a generic stub each, handed out round robin:
+//
+//     auto pool = ChannelPool::fromConfig(*Config::instance().snapshot());
+//     pool->stub().UnaryCall(&context, method, grpc::StubOptions(), &request, &response, on_done);
+//
+// Every channel has its own subchannel pool, so each one holds a separate HTTP/2 connection and
+// the calls are spread over several connections instead of being limited by the stream limit of one
+class GRPC_MOCK_SERVER_LIBRARY_API ChannelPool {
+public:
+    struct Settings {
+        std::size_t channel_count = 4;
+        // Keepalive pings are not sent if not set
+        std::optional<std::chrono::milliseconds> keepalive_time;
+        std::chrono::milliseconds keepalive_timeout = std::chrono::seconds(20);
+        bool keepalive_permit_without_calls = false;
+        // Messages larger than 4 MiB are rejected by default
+        std::optional<int> max_receive_message_size;
+    };
+
+private:
+    struct Entry {
+        std::shared_ptr<grpc::Channel> m_channel;
+        std::unique_ptr<grpc::GenericStub> m_stub;
+    };
+
+    std::string m_target;
+    std::vector<Entry> m_entries;
+    std::atomic<std::size_t> m_next;
+
+public:
+    ChannelPool(std::string target, std::shared_ptr<grpc::ChannelCredentials> credentials, const Settings& settings);
+
+    // Insecure pool to remote_host_url:remote_host_port; nullptr if the config has no remote host
+    static auto fromConfig(const ConfigSnapshot& config) -> std::shared_ptr<ChannelPool>;
+    static auto fromConfig(const ConfigSnapshot& config, const Settings& settings) -> std::shared_ptr<ChannelPool>;
+
+    // Next stub round robin, lock free
+    auto stub() -> grpc::GenericStub&;
+    auto channel(std::size_t index) const -> const std::shared_ptr<grpc::Channel>&;
+    std::size_t size() const;
+    const std::string& target() const;
+
+private:
+    ChannelPool(const ChannelPool& root) = delete;
+    ChannelPool& operator=(const ChannelPool&) = delete;
+};
+
+#endif // GRPC_MOCK_SERVER_CHANNEL_POOL_H
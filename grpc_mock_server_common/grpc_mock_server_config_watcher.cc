@@ -0,0 +1,240 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "grpc_mock_server_config_watcher.h"
+#include "grpc_mock_server_configuration.h"
+#include "grpc_mock_server_fs_utils.h"
+#include "grpc_mock_server_override_program.h"
+#include "grpc_mock_server_response.h"
+
+#include <iostream>
+#include <future>
+#include <map>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ConfigWatcher::ConfigWatcher(std::filesystem::path config_path, std::chrono::milliseconds poll_interval)
+    : m_config_path(std::filesystem::absolute(config_path)), m_poll_interval(poll_interval), m_reload_count(0) {
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    stop();
+}
+
+bool ConfigWatcher::start() {
+    assert(!isRunning());
+    if (!reloadConfig()) {
+        return false;
+    }
+    // Changes made right after start() returns must not be missed, so wait until the files are watched
+    // The promise is owned by the thread: it is still set if watching fails after start() has returned
+    std::promise<void> watching;
+    auto watching_future = watching.get_future();
+    m_thread = std::jthread([this, watching = std::move(watching)](std::stop_token stop_token) mutable {
+        try {
+            run(stop_token, watching);
+        }
+        catch (const std::exception& e) {
+            std::cout << "ERROR: unable to watch config files: " << e.what() << std::endl;
+            try {
+                watching.set_exception(std::current_exception());
+            }
+            catch (const std::future_error&) {
+                // start() has already returned, the files are no longer watched
+            }
+        }
+    });
+    try {
+        watching_future.get();
+    }
+    catch (const std::exception&) {
+        m_thread.join();
+        return false;
+    }
+    return true;
+}
+
+void ConfigWatcher::stop() {
+    if (m_thread.joinable()) {
+        m_thread.request_stop();
+        m_thread.join();
+    }
+}
+
+bool ConfigWatcher::isRunning() const {
+    return m_thread.joinable();
+}
+
+std::size_t ConfigWatcher::reloadCount() const {
+    return m_reload_count.load(std::memory_order_relaxed);
+}
+
+bool ConfigWatcher::reloadConfig() {
+    std::string config_data;
+    try {
+        config_data = grpc_mock_server::readFile(m_config_path.string());
+    }
+    catch (const std::ios_base::failure&) {
+        std::cout << "ERROR: unable to read config file " << m_config_path << std::endl;
+        return false;
+    }
+
+    if (!Config::instance().parse(config_data)) {
+        std::cout << "ERROR: invalid config file " << m_config_path << ", the previous one is kept" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ConfigWatcher::invalidateMockData() {
+    ResponseCache::instance().clear();
+    OverrideProgramCache::instance().clear();
+}
+
+auto ConfigWatcher::watchedPaths() const -> std::set<std::filesystem::path> {
+    std::set<std::filesystem::path> result = { m_config_path };
+    for (const auto& mock_path : Config::instance().snapshot()->mockPaths()) {
+        result.insert(std::filesystem::absolute(mock_path));
+    }
+    return result;
+}
+
+void ConfigWatcher::run(std::stop_token stop_token, std::promise<void>& watching) {
+#ifdef __linux__
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        runPolling(stop_token, watching);
+        return;
+    }
+    // Closes the descriptor also when watchedPaths() throws
+    struct InotifyDescriptor {
+        int m_fd;
+        ~InotifyDescriptor() {
+            close(m_fd);
+        }
+    } inotify_descriptor{ inotify_fd };
+
+    // Directories are watched rather than the files: editors often replace the file instead of writing into it
+    constexpr uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE;
+    std::set<std::filesystem::path> watched_paths;
+    std::map<int, std::filesystem::path> watched_directories;
+    auto updateWatches = [&] {
+        for (const auto& [watch_descriptor, directory] : watched_directories) {
+            inotify_rm_watch(inotify_fd, watch_descriptor);
+        }
+        watched_directories.clear();
+
+        watched_paths = watchedPaths();
+        std::set<std::filesystem::path> directories;
+        for (const auto& path : watched_paths) {
+            directories.insert(path.parent_path());
+        }
+        for (const auto& directory : directories) {
+            int watch_descriptor = inotify_add_watch(inotify_fd, directory.c_str(), watch_mask);
+            if (watch_descriptor >= 0) {
+                watched_directories[watch_descriptor] = directory;
+            }
+        }
+    };
+    updateWatches();
+    watching.set_value();
+
+    alignas(inotify_event) char buffer[16 * 1024];
+    while (!stop_token.stop_requested()) {
+        pollfd poll_fd{ inotify_fd, POLLIN, 0 };
+        if (poll(&poll_fd, 1, static_cast<int>(m_poll_interval.count())) <= 0) {
+            continue;
+        }
+
+        bool config_changed = false;
+        bool mock_data_changed = false;
+        ssize_t length = 0;
+        while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+            for (char* event_ptr = buffer; event_ptr < buffer + length; ) {
+                const auto* event = reinterpret_cast<const inotify_event*>(event_ptr);
+                event_ptr += sizeof(inotify_event) + event->len;
+
+                auto directory_it = watched_directories.find(event->wd);
+                if (event->len == 0 || directory_it == watched_directories.end()) {
+                    continue;
+                }
+                auto path = directory_it->second / event->name;
+                if (path == m_config_path) {
+                    config_changed = true;
+                }
+                else if (watched_paths.contains(path)) {
+                    mock_data_changed = true;
+                }
+            }
+        }
+
+        if (config_changed && reloadConfig()) {
+            // Mock files may be bound to other methods now
+            invalidateMockData();
+            updateWatches();
+            m_reload_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (mock_data_changed) {
+            invalidateMockData();
+            m_reload_count.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+#else
+    runPolling(stop_token, watching);
+#endif
+}
+
+void ConfigWatcher::runPolling(std::stop_token stop_token, std::promise<void>& watching) {
+    using WriteTimes = std::map<std::filesystem::path, std::filesystem::file_time_type>;
+    auto readWriteTimes = [this] {
+        WriteTimes result;
+        for (const auto& path : watchedPaths()) {
+            std::error_code error;
+            result[path] = std::filesystem::last_write_time(path, error);
+        }
+        return result;
+    };
+
+    WriteTimes write_times = readWriteTimes();
+    watching.set_value();
+    while (!stop_token.stop_requested()) {
+        std::this_thread::sleep_for(m_poll_interval);
+
+        std::error_code error;
+        auto config_write_time = std::filesystem::last_write_time(m_config_path, error);
+        if (!error && config_write_time != write_times[m_config_path]) {
+            if (reloadConfig()) {
+                invalidateMockData();
+                m_reload_count.fetch_add(1, std::memory_order_relaxed);
+            }
+            write_times = readWriteTimes();
+            continue;
+        }
+
+        auto current_write_times = readWriteTimes();
+        if (current_write_times != write_times) {
+            invalidateMockData();
+            m_reload_count.fetch_add(1, std::memory_order_relaxed);
+            write_times = std::move(current_write_times);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef GRPC_MOCK_SERVER_CONFIG_WATCHER_H
+#define GRPC_MOCK_SERVER_CONFIG_WATCHER_H
+
+#include "grpc_mock_server_export.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <set>
+#include <stop_token>
+#include <thread>
+
+// Reloads Config::instance() when the config file changes, and drops the cached responses and override programs
+// when any mock file referenced by the config changes, so they are reread on the next call.
+// Uses inotify on Linux and polls the file modification times elsewhere; all the work is done on a background thread,
+// serving threads only ever see the atomically published Config snapshots
+class GRPC_MOCK_SERVER_LIBRARY_API ConfigWatcher {
+    std::filesystem::path m_config_path;
+    std::chrono::milliseconds m_poll_interval;
+    std::atomic<std::size_t> m_reload_count;
+    std::jthread m_thread;
+
+public:
+    explicit ConfigWatcher(std::filesystem::path config_path, std::chrono::milliseconds poll_interval = std::chrono::milliseconds(500));
+    ~ConfigWatcher();
+
+    // Parse the config file and start watching; false if the config cannot be read, is invalid or cannot be watched
+    bool start();
+    void stop();
+    bool isRunning() const;
+
+    // Number of the config and mock data reloads, for diagnostics and tests
+    std::size_t reloadCount() const;
+
+private:
+    bool reloadConfig();
+    void invalidateMockData();
+    // Config file and the mock files it references, as absolute paths
+    auto watchedPaths() const -> std::set<std::filesystem::path>;
+
+    // The promise is fulfilled once the files are watched
+    void run(std::stop_token stop_token, std::promise<void>& watching);
+    void runPolling(std::stop_token stop_token, std::promise<void>& watching);
+
+    ConfigWatcher(const ConfigWatcher& root) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+};
+
+#endif // GRPC_MOCK_SERVER_CONFIG_WATCHER_H
@@ -17,77 +17,134 @@
  */
 
 #include "grpc_mock_server_configuration.h"
+#include "grpc_mock_server_metrics.h"
+
+#include <iostream>
 
 Config& Config::instance() {
     static Config instance;
     return instance;
 }
 
-bool Config::haveRemoteHostUrl() const {
+bool ConfigSnapshot::haveRemoteHostUrl() const {
     return m_remote_host_url.has_value();
 }
 
-bool Config::haveRemoteHostPort() const {
+bool ConfigSnapshot::haveRemoteHostPort() const {
     return m_remote_host_port.has_value();
 }
 
-bool Config::haveLocalHostPort() const {
+bool ConfigSnapshot::haveLocalHostPort() const {
     return m_local_host_port.has_value();
 }
 
-std::string Config::remoteHostUrl() const {
+std::string ConfigSnapshot::remoteHostUrl() const {
     assert(haveRemoteHostUrl());
     return m_remote_host_url.value_or("");
 }
 
-int Config::remoteHostPort() const {
+int ConfigSnapshot::remoteHostPort() const {
     assert(haveRemoteHostPort());
     return m_remote_host_port.value_or(-1);
 }
 
-int Config::localHostPort() const {
+int ConfigSnapshot::localHostPort() const {
     assert(haveLocalHostPort());
     return m_local_host_port.value_or(-1);
 }
 
-bool Config::haveFullPath(const std::string& method_name) const {
-    if (m_methods.contains(method_name)) {
-        return !m_methods.at(method_name).m_full_path.empty();
-    }
-    return false;
+bool ConfigSnapshot::haveFullPath(const std::string& method_name) const {
+    auto method = findMethod(method_name);
+    return method != nullptr && !method->m_full_path.empty();
 }
 
-bool Config::havePartialPath(const std::string& method_name) const {
-    if (m_methods.contains(method_name)) {
-        return !m_methods.at(method_name).m_partial_path.empty();
-    }
-    return false;
+bool ConfigSnapshot::havePartialPath(const std::string& method_name) const {
+    auto method = findMethod(method_name);
+    return method != nullptr && !method->m_partial_path.empty();
 }
 
-std::string Config::fullPath(const std::string& method_name) const {
+std::string ConfigSnapshot::fullPath(const std::string& method_name) const {
     assert(haveFullPath(method_name));
-    return m_methods.at(method_name).m_full_path;
+    auto method = findMethod(method_name);
+    return method != nullptr ? method->m_full_path : std::string();
 }
 
-std::string Config::partialPath(const std::string& method_name) const {
+std::string ConfigSnapshot::partialPath(const std::string& method_name) const {
     assert(havePartialPath(method_name));
-    return m_methods.at(method_name).m_partial_path;
+    auto method = findMethod(method_name);
+    return method != nullptr ? method->m_partial_path : std::string();
+}
+
+auto ConfigSnapshot::datasetId(std::string_view dataset_name) const -> std::optional<DatasetId> {
+    auto it = m_dataset_ids.find(dataset_name);
+    return it != m_dataset_ids.end() ? std::optional(it->second) : std::nullopt;
+}
+
+auto ConfigSnapshot::methodId(std::string_view method_path) const -> std::optional<MethodId> {
+    if (method_path.starts_with('/')) {
+        method_path.remove_prefix(1);
+    }
+    auto it = m_method_ids.find(method_path);
+    return it != m_method_ids.end() ? std::optional(it->second) : std::nullopt;
+}
+
+auto ConfigSnapshot::findMethod(DatasetId dataset_id, MethodId method_id) const -> const MethodDescription* {
+    if (dataset_id >= m_routes.size() || method_id >= m_routes[dataset_id].size()) {
+        return nullptr;
+    }
+    auto method_index = m_routes[dataset_id][method_id];
+    return method_index != kNoMethod ? &m_methods[method_index] : nullptr;
+}
+
+auto ConfigSnapshot::findMethod(std::string_view dataset_name, std::string_view method_path) const -> const MethodDescription* {
+    auto dataset_id = datasetId(dataset_name);
+    auto method_id = methodId(method_path);
+    if (!dataset_id.has_value() || !method_id.has_value()) {
+        return nullptr;
+    }
+    return findMethod(dataset_id.value(), method_id.value());
+}
+
+auto ConfigSnapshot::findMethod(std::string_view method_name) const -> const MethodDescription* {
+    auto it = m_method_indexes.find(method_name);
+    return it != m_method_indexes.end() ? &m_methods[it->second] : nullptr;
+}
+
+auto ConfigSnapshot::methodMetrics(const MethodDescription& method) const -> MethodMetrics* {
+    assert(&method >= m_methods.data() && &method < m_methods.data() + m_methods.size());
+    auto& slot = m_metrics[static_cast<std::size_t>(&method - m_methods.data())];
+    auto metrics = slot.load(std::memory_order_acquire);
+    if (metrics == nullptr) {
+        // Racing threads get the same registry entry
+        metrics = MetricsRegistry::instance().method(method.m_method_name);
+        slot.store(metrics, std::memory_order_release);
+    }
+    return metrics;
+}
+
+std::vector<std::string> ConfigSnapshot::mockPaths() const {
+    std::vector<std::string> result;
+    for (const auto& method_description : m_methods) {
+        if (!method_description.m_full_path.empty()) {
+            result.push_back(method_description.m_full_path);
+        }
+        if (!method_description.m_partial_path.empty()) {
+            result.push_back(method_description.m_partial_path);
+        }
+    }
+    return result;
 }
 
-bool Config::parseConfigXml(
-    const std::string& data,
-    MethodDescriptions& methods,
-    std::optional<std::string>& remote_host_url,
-    std::optional<int>& remote_host_port,
-    std::optional<int>& local_host_port
-) {
-    std::string full_path;
-    std::string partial_path;
+bool Config::parseConfigXml(const std::string& data, ConfigSnapshot& snapshot) {
+    auto& remote_host_url = snapshot.m_remote_host_url;
+    auto& remote_host_port = snapshot.m_remote_host_port;
+    auto& local_host_port = snapshot.m_local_host_port;
 
     pugi::xml_document doc;
     pugi::xml_parse_result parser_result = doc.load_buffer(data.data(), data.size());
     if (!parser_result) {
-        assert(0);
+        // Not an assertion: a file being rewritten may be picked up by the reload in the middle of the write
+        std::cout << "ERROR: invalid config: " << parser_result.description() << std::endl;
         return false;
     }
 
@@ -107,34 +164,136 @@ bool Config::parseConfigXml(
     auto xpath_result_nodes = doc.select_nodes("/root/dataset/package/service/child::node()");
     for (pugi::xpath_node xpath_node : xpath_result_nodes) {
         pugi::xml_node node = xpath_node.node();
+        // Comments
+        if (node.type() != pugi::node_element) {
+            continue;
+        }
         auto service_node = node.parent();
         auto package_node = service_node.parent();
         auto dataset_node = package_node.parent();
 
-        auto full_method_name =
-            std::string(dataset_node.attribute("name").as_string())
-            + "." + package_node.attribute("name").as_string()
+        std::string dataset_name = dataset_node.attribute("name").as_string();
+        auto method_path =
+            std::string(package_node.attribute("name").as_string())
             + "." + service_node.attribute("name").as_string()
             + "/" + node.attribute("name").as_string();
 
+        // Paths are not inherited from the previous method
+        std::string full_path;
+        std::string partial_path;
         pugi::xml_node full_node = node.child("full");
         pugi::xml_node partial_node = node.child("partial");
         if (!full_node.attribute("path").empty()) {
             full_path = full_node.attribute("path").as_string();
         }
+        // <full path="x.binpb" /> or <full path="x" format="binary" />: the response loader tells the formats apart by
+        // the binary header, so the attribute is only checked here
+        std::string_view full_format = full_node.attribute("format").as_string();
+        if (!full_format.empty() && full_format != "json" && full_format != "binary") {
+            std::cout << "ERROR: invalid config: unknown response format " << full_format << " of " << method_path << std::endl;
+            return false;
+        }
         if (!partial_node.attribute("path").empty()) {
             partial_path = partial_node.attribute("path").as_string();
         }
 
-        methods[full_method_name] = MethodDescription(full_path, partial_path);
+        auto [dataset_it, dataset_inserted] =
+            snapshot.m_dataset_ids.try_emplace(dataset_name, static_cast<ConfigSnapshot::DatasetId>(snapshot.m_routes.size()));
+        if (dataset_inserted) {
+            snapshot.m_routes.emplace_back();
+        }
+        auto [method_it, method_inserted] =
+            snapshot.m_method_ids.try_emplace(method_path, static_cast<ConfigSnapshot::MethodId>(snapshot.m_method_ids.size()));
+
+        auto& routes = snapshot.m_routes[dataset_it->second];
+        if (routes.size() <= method_it->second) {
+            routes.resize(method_it->second + 1, ConfigSnapshot::kNoMethod);
+        }
+        auto method = ConfigSnapshot::MethodDescription(dataset_name + "." + method_path, full_path, partial_path);
+        if (routes[method_it->second] != ConfigSnapshot::kNoMethod) {
+            // The last declaration of the method wins
+            snapshot.m_methods[routes[method_it->second]] = std::move(method);
+        }
+        else {
+            routes[method_it->second] = static_cast<std::uint32_t>(snapshot.m_methods.size());
+            snapshot.m_method_indexes.try_emplace(method.m_method_name, routes[method_it->second]);
+            snapshot.m_methods.push_back(std::move(method));
+        }
     }
 
-    return !methods.empty();
+    snapshot.m_metrics = std::make_unique<std::atomic<MethodMetrics*>[]>(snapshot.m_methods.size());
+    return !snapshot.m_methods.empty();
 }
 
-Config::Config() {
+Config::Config()
+    : m_snapshot(std::make_shared<const ConfigSnapshot>()), m_version(0) {
 }
 
 bool Config::parse(const std::string& data) {
-    return parseConfigXml(data, m_methods, m_remote_host_url, m_remote_host_port, m_local_host_port);
+    auto snapshot = std::make_shared<ConfigSnapshot>();
+    if (!parseConfigXml(data, *snapshot)) {
+        return false;
+    }
+
+    m_snapshot.store(std::move(snapshot), std::memory_order_release);
+    m_version.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+auto Config::snapshot() const -> std::shared_ptr<const ConfigSnapshot> {
+    return current();
+}
+
+auto Config::current() const -> const std::shared_ptr<const ConfigSnapshot>& {
+    // The published pointer is loaded only after a reload, otherwise a single atomic counter read is enough.
+    // Config is a singleton, so the thread local copy always belongs to this instance
+    thread_local std::shared_ptr<const ConfigSnapshot> snapshot;
+    thread_local std::uint64_t snapshot_version = 0;
+
+    auto version = m_version.load(std::memory_order_acquire);
+    if (!snapshot || version != snapshot_version) {
+        snapshot = m_snapshot.load(std::memory_order_acquire);
+        snapshot_version = version;
+    }
+    return snapshot;
+}
+
+bool Config::haveRemoteHostUrl() const {
+    return current()->haveRemoteHostUrl();
+}
+
+bool Config::haveRemoteHostPort() const {
+    return current()->haveRemoteHostPort();
+}
+
+bool Config::haveLocalHostPort() const {
+    return current()->haveLocalHostPort();
+}
+
+std::string Config::remoteHostUrl() const {
+    return current()->remoteHostUrl();
+}
+
+int Config::remoteHostPort() const {
+    return current()->remoteHostPort();
+}
+
+int Config::localHostPort() const {
+    return current()->localHostPort();
+}
+
+bool Config::haveFullPath(const std::string& method_name) const {
+    return current()->haveFullPath(method_name);
+}
+
+bool Config::havePartialPath(const std::string& method_name) const {
+    return current()->havePartialPath(method_name);
+}
+
+std::string Config::fullPath(const std::string& method_name) const {
+    return current()->fullPath(method_name);
+}
+
+std::string Config::partialPath(const std::string& method_name) const {
+    return current()->partialPath(method_name);
 }
@@ -26,31 +26,121 @@
 #include <sstream>
 #include <random>
 #include <iomanip>
-#include <map>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <optional>
+#include <vector>
 
 // XML parser
 #include <pugixml.hpp>
 #include "grpc_mock_server_export.h"
 
-class GRPC_MOCK_SERVER_LIBRARY_API Config {
+class MethodMetrics;
+
+// Immutable result of a single Config::parse() call; may be read from any number of threads
+class GRPC_MOCK_SERVER_LIBRARY_API ConfigSnapshot {
+    friend class Config;
+
+public:
+    using DatasetId = std::uint32_t;
+    using MethodId = std::uint32_t;
 
     struct MethodDescription {
+        // Interned method key "dataset.package.Service/Method", used by the caches
+        std::string m_method_name;
         std::string m_full_path;
         std::string m_partial_path;
     };
-    using MethodName = std::string;
-    using MethodDescriptions = std::map<MethodName, MethodDescription>;
-    MethodDescriptions m_methods;
+
+private:
+    // Lookup by std::string_view without building a temporary std::string
+    struct StringHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view value) const {
+            return std::hash<std::string_view>()(value);
+        }
+    };
+    template <typename Value>
+    using StringMap = std::unordered_map<std::string, Value, StringHash, std::equal_to<>>;
+
+    // Datasets and method paths ("package.Service/Method") are interned into dense ids at parse time,
+    // a method is then found by indexing m_routes[dataset id][method id]
+    StringMap<DatasetId> m_dataset_ids;
+    StringMap<MethodId> m_method_ids;
+    std::vector<MethodDescription> m_methods;
+    // Index in m_methods, kNoMethod if the dataset does not mock the method; rows may be shorter than the method count
+    std::vector<std::vector<std::uint32_t>> m_routes;
+    // Index in m_methods by the full method key; dataset names may contain dots, so the key is not split
+    StringMap<std::uint32_t> m_method_indexes;
+    // MethodMetrics by index in m_methods, nullptr until the method is called first
+    std::unique_ptr<std::atomic<MethodMetrics*>[]> m_metrics;
+    static constexpr std::uint32_t kNoMethod = std::numeric_limits<std::uint32_t>::max();
+
     std::optional<std::string> m_remote_host_url;
     std::optional<int> m_remote_host_port;
     std::optional<int> m_local_host_port;
 
+public:
+    ConfigSnapshot() = default;
+
+    // Remote gRPC server data
+    bool haveRemoteHostUrl() const;
+    bool haveRemoteHostPort() const;
+    bool haveLocalHostPort() const;
+    std::string remoteHostUrl() const;
+    int remoteHostPort() const;
+    int localHostPort() const;
+
+    // Mock data
+    bool haveFullPath(const std::string& method_name) const;
+    bool havePartialPath(const std::string& method_name) const;
+    std::string fullPath(const std::string& method_name) const;
+    std::string partialPath(const std::string& method_name) const;
+
+    // Ids are valid for this snapshot only; nullopt if no dataset mocks the name.
+    // Method path is the gRPC one, e.g. "/routeguide.RouteGuide/GetFeature", leading slash is optional
+    auto datasetId(std::string_view dataset_name) const -> std::optional<DatasetId>;
+    auto methodId(std::string_view method_path) const -> std::optional<MethodId>;
+
+    // nullptr if the method is not mocked. The pointer is valid as long as the snapshot is alive
+    auto findMethod(DatasetId dataset_id, MethodId method_id) const -> const MethodDescription*;
+    auto findMethod(std::string_view dataset_name, std::string_view method_path) const -> const MethodDescription*;
+    // Method key "dataset.package.Service/Method"
+    auto findMethod(std::string_view method_name) const -> const MethodDescription*;
+
+    // Metrics of a method of this snapshot: registered to MetricsRegistry::instance() on the first call, then kept here,
+    // so calls do not look the method key up in the registry
+    auto methodMetrics(const MethodDescription& method) const -> MethodMetrics*;
+
+    // Full and partial paths of all the methods
+    std::vector<std::string> mockPaths() const;
+
+private:
+    ConfigSnapshot(const ConfigSnapshot& root) = delete;
+    ConfigSnapshot& operator=(const ConfigSnapshot&) = delete;
+};
+
+// Current configuration. Every parse() builds a new ConfigSnapshot and publishes it atomically,
+// so the configuration may be reloaded while other threads read it; readers never wait for the reload.
+// Accessors read the current snapshot one by one, use snapshot() to read several values consistently
+class GRPC_MOCK_SERVER_LIBRARY_API Config {
+    std::atomic<std::shared_ptr<const ConfigSnapshot>> m_snapshot;
+    // Incremented after every publication, lets readers reuse their thread local copy of the snapshot
+    std::atomic<std::uint64_t> m_version;
+
 public:
     static Config& instance();
 
+    // Keeps the current snapshot if the data is invalid
     bool parse(const std::string& data);
 
+    // Never nullptr, the snapshot is empty before the first successful parse()
+    auto snapshot() const -> std::shared_ptr<const ConfigSnapshot>;
+
     // Remote gRPC server data
     bool haveRemoteHostUrl() const;
     bool haveRemoteHostPort() const;
@@ -66,13 +156,10 @@ public:
     std::string partialPath(const std::string& method_name) const;
 
 private:
-    static bool parseConfigXml(
-        const std::string& data,
-        MethodDescriptions& methods,
-        std::optional<std::string>& remote_host_url,
-        std::optional<int>& remote_host_port,
-        std::optional<int>& local_host_port
-    );
+    // Thread local copy of the published snapshot
+    auto current() const -> const std::shared_ptr<const ConfigSnapshot>&;
+
+    static bool parseConfigXml(const std::string& data, ConfigSnapshot& snapshot);
 
 private:
     Config();
@@ -18,24 +18,212 @@
 
 #include "grpc_mock_server_fs_utils.h"
 
+#include <limits>
+#include <utility>
+
+#if defined(_WIN32) || defined(_WIN64)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace grpc_mock_server {
 
-auto readFile(std::string_view path) -> std::string {
-    constexpr auto read_size = std::size_t(4096);
-    auto stream = std::ifstream(path.data());
+namespace {
+
+auto readWholeFile(std::string_view path, std::ios_base::openmode mode) -> std::string {
+    auto stream = std::ifstream(std::string(path), mode);
     stream.exceptions(std::ios_base::badbit);
 
     if (not stream) {
         throw std::ios_base::failure("file does not exist");
     }
 
-    auto out = std::string();
-    auto buf = std::string(read_size, '\0');
-    while (stream.read(&buf[0], read_size)) {
-        out.append(buf, 0, stream.gcount());
+    // Text mode may translate line ends, so the size is an upper bound and the string is shrunk to the read count
+    std::error_code error;
+    auto file_size = std::filesystem::file_size(std::filesystem::path(path), error);
+    auto out = std::string(error ? 0 : static_cast<std::size_t>(file_size), '\0');
+    stream.read(out.data(), static_cast<std::streamsize>(out.size()));
+    out.resize(static_cast<std::size_t>(stream.gcount()));
+
+    // The file may grow after file_size()
+    char buf[4096];
+    while (stream.read(buf, sizeof(buf)) || stream.gcount() > 0) {
+        out.append(buf, static_cast<std::size_t>(stream.gcount()));
     }
-    out.append(buf, 0, stream.gcount());
     return out;
 }
 
+} // anonymous namespace
+
+auto readFile(std::string_view path) -> std::string {
+    return readWholeFile(path, std::ios_base::in);
+}
+
+auto readBinaryFile(std::string_view path) -> std::string {
+    return readWholeFile(path, std::ios_base::in | std::ios_base::binary);
+}
+
 } // grpc_mock_server
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0)) {
+#if defined(_WIN32) || defined(_WIN64)
+    m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+#if defined(_WIN32) || defined(_WIN64)
+        m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+auto MappedFile::open(const std::filesystem::path& path, Access access) -> std::optional<MappedFile> {
+    MappedFile result;
+
+#if defined(_WIN32) || defined(_WIN64)
+    auto file = ::CreateFileW(
+        path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+        access == Access::sequential ? FILE_FLAG_SEQUENTIAL_SCAN : (access == Access::random ? FILE_FLAG_RANDOM_ACCESS : FILE_ATTRIBUTE_NORMAL),
+        nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE) {
+        return std::nullopt;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!::GetFileSizeEx(file, &file_size)) {
+        ::CloseHandle(file);
+        return std::nullopt;
+    }
+    if (file_size.QuadPart == 0) {
+        ::CloseHandle(file);
+        return result;
+    }
+
+    // The mapping keeps the file open, so the file handle is not needed anymore
+    auto mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    ::CloseHandle(file);
+    if (mapping == nullptr) {
+        return std::nullopt;
+    }
+    auto data = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+        ::CloseHandle(mapping);
+        return std::nullopt;
+    }
+
+    result.m_mapping = mapping;
+    result.m_data = static_cast<const char*>(data);
+    result.m_size = static_cast<std::size_t>(file_size.QuadPart);
+#else
+    int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        return std::nullopt;
+    }
+
+    struct stat file_stat;
+    if (::fstat(file, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        ::close(file);
+        return std::nullopt;
+    }
+    if (file_stat.st_size == 0) {
+        ::close(file);
+        return result;
+    }
+
+    // The mapping keeps its own reference to the file
+    auto size = static_cast<std::size_t>(file_stat.st_size);
+    auto data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (data == MAP_FAILED) {
+        return std::nullopt;
+    }
+
+    int advice = MADV_NORMAL;
+    switch (access) {
+        case Access::sequential: {
+            advice = MADV_SEQUENTIAL;
+            break;
+        }
+        case Access::random: {
+            advice = MADV_RANDOM;
+            break;
+        }
+        case Access::will_need: {
+            advice = MADV_WILLNEED;
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+    if (advice != MADV_NORMAL) {
+        ::madvise(data, size, advice);
+    }
+
+    result.m_data = static_cast<const char*>(data);
+    result.m_size = size;
+#endif
+
+    return result;
+}
+
+auto MappedFile::view() const -> std::string_view {
+    return std::string_view(m_data, m_size);
+}
+
+auto MappedFile::bytes() const -> std::span<const std::byte> {
+    return std::span<const std::byte>(reinterpret_cast<const std::byte*>(m_data), m_size);
+}
+
+std::size_t MappedFile::size() const {
+    return m_size;
+}
+
+bool MappedFile::empty() const {
+    return m_size == 0;
+}
+
+auto MappedFile::inputStream() const -> google::protobuf::io::ArrayInputStream {
+    if (m_size > static_cast<std::size_t>(std::numeric_limits<int>::max())) {
+        return google::protobuf::io::ArrayInputStream(nullptr, 0);
+    }
+    return google::protobuf::io::ArrayInputStream(m_data, static_cast<int>(m_size));
+}
+
+void MappedFile::unmap() {
+    if (m_data != nullptr) {
+#if defined(_WIN32) || defined(_WIN64)
+        ::UnmapViewOfFile(m_data);
+        ::CloseHandle(m_mapping);
+        m_mapping = nullptr;
+#else
+        ::munmap(const_cast<char*>(m_data), m_size);
+#endif
+    }
+    m_data = nullptr;
+    m_size = 0;
+}
@@ -21,13 +21,78 @@
 
 #include "grpc_mock_server_export.h"
 
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
 #include <string_view>
 #include <fstream>
 
 namespace grpc_mock_server {
 
+// Whole file in a single read, the string is allocated once
 GRPC_MOCK_SERVER_LIBRARY_API auto readFile(std::string_view path) -> std::string;
+// Same as readFile() in binary mode, line ends are not translated on Windows
+GRPC_MOCK_SERVER_LIBRARY_API auto readBinaryFile(std::string_view path) -> std::string;
+
+// How the caches of parsed files notice file changes
+enum class CacheInvalidation {
+    // Only clear() drops the entries, e.g. called by ConfigWatcher; nothing is checked per call
+    clear,
+    // Modification time is checked on every call, it costs a stat() per call
+    write_time
+};
 
 } // namespace grpc_mock_server
 
+// Read only memory mapping of a whole file, the data is valid until the MappedFile is destroyed or moved from.
+// Nothing is copied: pages are read by the OS on first access and stay in the page cache, not in the process heap.
+// The file is mapped in binary mode, line ends are not translated on Windows.
+// Reading a POSIX mapping of a file truncated meanwhile raises SIGBUS: a mapped file must be replaced by rename,
+// which keeps the old contents mapped, rather than rewritten in place
+class GRPC_MOCK_SERVER_LIBRARY_API MappedFile {
+public:
+    // Access pattern hint (madvise() on POSIX, FILE_FLAG_SEQUENTIAL_SCAN or FILE_FLAG_RANDOM_ACCESS on Windows)
+    enum class Access {
+        normal,
+        sequential, // The data is read once from the beginning, e.g. parsed
+        random,     // The data is read at random offsets, read-ahead is disabled
+        will_need   // Pages are read ahead right away
+    };
+
+private:
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+#if defined(_WIN32) || defined(_WIN64)
+    void* m_mapping = nullptr;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    // nullopt if the file cannot be opened or mapped; an empty file gives an empty view
+    static auto open(const std::filesystem::path& path, Access access = Access::sequential) -> std::optional<MappedFile>;
+
+    auto view() const -> std::string_view;
+    auto bytes() const -> std::span<const std::byte>;
+    std::size_t size() const;
+    bool empty() const;
+
+    // Stream over the mapped data for Message::ParseFromZeroCopyStream() and CodedInputStream.
+    // Protobuf streams are limited to 2 GiB, the stream is empty for the larger files
+    auto inputStream() const -> google::protobuf::io::ArrayInputStream;
+
+private:
+    void unmap();
+
+    MappedFile(const MappedFile& root) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
 #endif // GRPC_MOCK_SERVER_FS_UTILS_H
@@ -0,0 +1,146 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "grpc_mock_server_generic_service.h"
+#include "grpc_mock_server_configuration.h"
+#include "grpc_mock_server_utils.h"
+
+#include <google/protobuf/descriptor.h>
+
+#include <functional>
+#include <unordered_map>
+
+namespace {
+
+// Writes the prepared response, or finishes the call with an error, and deletes itself when the call is done
+class MockResponseReactor : public grpc::ServerGenericBidiReactor {
+    grpc::ByteBuffer m_response;
+
+public:
+    explicit MockResponseReactor(const grpc::ByteBuffer& response)
+        : m_response(response) {
+        StartWriteAndFinish(&m_response, grpc::WriteOptions(), grpc::Status::OK);
+    }
+
+    explicit MockResponseReactor(const grpc::Status& status) {
+        Finish(status);
+    }
+
+    void OnDone() override {
+        delete this;
+    }
+};
+
+struct StringHash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view value) const {
+        return std::hash<std::string_view>()(value);
+    }
+};
+
+auto findResponsePrototype(std::string_view method_path) -> const google::protobuf::Message* {
+    // "/package.Service/Method" -> "package.Service.Method"
+    if (!method_path.starts_with('/')) {
+        return nullptr;
+    }
+    std::string method_full_name(method_path.substr(1));
+    auto slash_pos = method_full_name.find('/');
+    if (slash_pos == std::string::npos) {
+        return nullptr;
+    }
+    method_full_name[slash_pos] = '.';
+
+    auto method_descriptor = google::protobuf::DescriptorPool::generated_pool()->FindMethodByName(method_full_name);
+    if (method_descriptor == nullptr || method_descriptor->client_streaming() || method_descriptor->server_streaming()) {
+        return nullptr;
+    }
+    return google::protobuf::MessageFactory::generated_factory()->GetPrototype(method_descriptor->output_type());
+}
+
+} // anonymous namespace
+
+MockGenericService::MockGenericService(ResponseCache& cache)
+    : m_cache(cache) {
+}
+
+grpc::ServerGenericBidiReactor* MockGenericService::CreateReactor(grpc::GenericCallbackServerContext* context) {
+    // Dataset and method are resolved to their interned ids, no method key is built per call;
+    // the snapshot keeps the method description alive until the response is built
+    auto config = Config::instance().snapshot();
+    auto dataset_id = getDatasetId(*config, context);
+    auto method_id = config->methodId(context->method());
+    auto method = dataset_id.has_value() && method_id.has_value() ? config->findMethod(dataset_id.value(), method_id.value()) : nullptr;
+
+    if (method == nullptr) {
+        return finishWith(grpc::Status(grpc::UNIMPLEMENTED, "no mock data for " + context->method()));
+    }
+
+    // Only the methods found in the config are measured, so unknown paths cannot grow the registry
+    auto metrics = config->methodMetrics(*method);
+    // Unary request is never read: the response does not depend on it
+    auto response = respond(*method, context->method(), metrics);
+    if (metrics != nullptr) {
+        metrics->recordCall(response.has_value());
+    }
+    if (!response.has_value()) {
+        return finishWith(grpc::Status(grpc::UNIMPLEMENTED, "no mock data for " + context->method()));
+    }
+    return respondWith(response.value());
+}
+
+auto MockGenericService::respond(const ConfigSnapshot::MethodDescription& method, std::string_view method_path, MethodMetrics* metrics)
+    -> std::optional<grpc::ByteBuffer> {
+    if (method.m_full_path.empty() && method.m_partial_path.empty()) {
+        return std::nullopt;
+    }
+
+    auto prototype = responsePrototype(method_path);
+    if (prototype == nullptr) {
+        return std::nullopt;
+    }
+
+    return m_cache.buildWire(*prototype, method.m_method_name, method.m_full_path, method.m_partial_path, metrics);
+}
+
+auto MockGenericService::responsePrototype(std::string_view method_path) -> const google::protobuf::Message* {
+    // Generated pool lookups take the pool mutex, so the resolved prototypes are kept per thread.
+    // Unknown paths are not kept: clients could grow the map without a bound
+    thread_local std::unordered_map<std::string, const google::protobuf::Message*, StringHash, std::equal_to<>> prototypes;
+    auto it = prototypes.find(method_path);
+    if (it != prototypes.end()) {
+        return it->second;
+    }
+
+    auto prototype = findResponsePrototype(method_path);
+    if (prototype != nullptr) {
+        prototypes.emplace(method_path, prototype);
+    }
+    return prototype;
+}
+
+auto MockGenericService::cache() -> ResponseCache& {
+    return m_cache;
+}
+
+auto MockGenericService::respondWith(const grpc::ByteBuffer& response) -> grpc::ServerGenericBidiReactor* {
+    return new MockResponseReactor(response);
+}
+
+auto MockGenericService::finishWith(const grpc::Status& status) -> grpc::ServerGenericBidiReactor* {
+    return new MockResponseReactor(status);
+}
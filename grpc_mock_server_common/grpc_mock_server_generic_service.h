@@ -0,0 +1,71 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef GRPC_MOCK_SERVER_GENERIC_SERVICE_H
+#define GRPC_MOCK_SERVER_GENERIC_SERVICE_H
+
+#include "grpc_mock_server_export.h"
+#include "grpc_mock_server_configuration.h"
+#include "grpc_mock_server_metrics.h"
+#include "grpc_mock_server_response.h"
+
+#include <grpcpp/generic/async_generic_service.h>
+#include <google/protobuf/message.h>
+
+#include <string>
+#include <string_view>
+
+// Serves the unary methods listed in Config without generated service code:
+//
+//     MockGenericService service;
+//     builder.RegisterCallbackGenericService(&service);
+//
+// Methods with a full response only are answered with the cached wire bytes, nothing is parsed or serialized per call;
+// partial overrides are served as described in ResponseCache::buildWire().
+// Calls and stage times of the mocked methods are recorded to MetricsRegistry::instance()
+// Response types are looked up in the generated descriptor pool, so the generated code of the services must be linked in
+class GRPC_MOCK_SERVER_LIBRARY_API MockGenericService : public grpc::CallbackGenericService {
+    ResponseCache& m_cache;
+
+public:
+    explicit MockGenericService(ResponseCache& cache = ResponseCache::instance());
+
+    grpc::ServerGenericBidiReactor* CreateReactor(grpc::GenericCallbackServerContext* context) override;
+
+    // Response wire bytes of the method found in the config, method path is the gRPC one, e.g. "/routeguide.RouteGuide/GetFeature";
+    // nullopt if the method has no mock data or it is invalid
+    auto respond(const ConfigSnapshot::MethodDescription& method, std::string_view method_path, MethodMetrics* metrics = nullptr)
+        -> std::optional<grpc::ByteBuffer>;
+
+    // Response prototype of the gRPC method path, e.g. "/routeguide.RouteGuide/GetFeature";
+    // nullptr if the method is unknown or streaming
+    static auto responsePrototype(std::string_view method_path) -> const google::protobuf::Message*;
+
+protected:
+    auto cache() -> ResponseCache&;
+
+    // Reactors answering the call without reading the request, they delete themselves when the call is done
+    static auto respondWith(const grpc::ByteBuffer& response) -> grpc::ServerGenericBidiReactor*;
+    static auto finishWith(const grpc::Status& status) -> grpc::ServerGenericBidiReactor*;
+
+private:
+    MockGenericService(const MockGenericService& root) = delete;
+    MockGenericService& operator=(const MockGenericService&) = delete;
+};
+
+#endif // GRPC_MOCK_SERVER_GENERIC_SERVICE_H
@@ -18,31 +18,67 @@
 
 #include "grpc_mock_server_logger.h"
 
+#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/sinks/rotating_file_sink.h>
+
 #include <iostream>
 #include <memory>
+#include <vector>
 
 namespace grpc_mock_server {
 
-bool initLogLibrary() {
-    try {
-        std::cout << "initializing spdlog..." << std::endl;
+namespace {
 
-        // Console multi threaded logger with color
+auto createSinks(const LogSettings& settings) -> std::vector<spdlog::sink_ptr> {
+    switch (settings.sink) {
+        case LogSettings::Sink::file: {
+            return { std::make_shared<spdlog::sinks::basic_file_sink_mt>(settings.file_path) };
+        }
+        case LogSettings::Sink::rotating_file: {
+            return { std::make_shared<spdlog::sinks::rotating_file_sink_mt>(settings.file_path, settings.max_file_size, settings.max_files) };
+        }
+        case LogSettings::Sink::console: {
+            break;
+        }
+    }
+
+    // Console multi threaded logger with color
 #if defined(ANDROID)
-        spdlog::android_logger_mt("system", "gRPC mock server");
+    return { std::make_shared<spdlog::sinks::android_sink_mt>("gRPC mock server") };
 #elif defined(_WIN32) || defined(_WIN64)
-        auto sink_debug = std::make_shared<spdlog::sinks::msvc_sink_mt>();
-        auto sink_console = std::make_shared<spdlog::sinks::wincolor_stdout_sink_mt>();
-        spdlog::logger logger1("multi_sink", { sink_debug, sink_console });
-        spdlog::sinks_init_list sinks = { sink_debug, sink_console };
-        auto logger = std::make_shared<spdlog::logger>("system", sinks);
-        spdlog::register_logger(logger);
+    return { std::make_shared<spdlog::sinks::msvc_sink_mt>(), std::make_shared<spdlog::sinks::wincolor_stdout_sink_mt>() };
 #else
-        spdlog::stdout_color_mt("system");
+    return { std::make_shared<spdlog::sinks::stdout_color_sink_mt>() };
 #endif
+}
+
+} // anonymous namespace
+
+bool initLogLibrary() {
+    return initLogLibrary(LogSettings());
+}
+
+bool initLogLibrary(const LogSettings& settings) {
+    try {
+        std::cout << "initializing spdlog..." << std::endl;
+
+        auto sinks = createSinks(settings);
+        std::shared_ptr<spdlog::logger> logger;
+        if (settings.async) {
+            // Single queue shared by all the asynchronous loggers
+            spdlog::init_thread_pool(settings.queue_size, settings.thread_count);
+            logger = std::make_shared<spdlog::async_logger>(
+                "system", sinks.begin(), sinks.end(), spdlog::thread_pool(), settings.overflow_policy
+            );
+        }
+        else {
+            logger = std::make_shared<spdlog::logger>("system", sinks.begin(), sinks.end());
+        }
+        spdlog::register_logger(logger);
+
         // Customize msg format for all messages
         spdlog::set_pattern("[%^%L%$][%D %H:%M:%S.%e][%P:%t] %v");
-        spdlog::set_level(spdlog::level::trace);
+        spdlog::set_level(settings.level);
 
         spdlog::flush_every(std::chrono::seconds(3));
 
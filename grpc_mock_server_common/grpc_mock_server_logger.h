@@ -22,9 +22,13 @@
 #include "grpc_mock_server_export.h"
 
 #include <spdlog/spdlog.h>
+#include <spdlog/async.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/fmt/ostr.h>
 
+#include <cstddef>
+#include <string>
+
 #if defined(ANDROID)
 #include <spdlog/sinks/android_sink.h>
 #endif
@@ -37,7 +41,32 @@
 
 namespace grpc_mock_server {
 
+struct LogSettings {
+    enum class Sink {
+        console,
+        file,
+        rotating_file
+    };
+
+    // Asynchronous logger formats the message on the caller thread and writes it on the logging thread,
+    // the caller only waits when the queue is full and the overflow policy is block
+    bool async = false;
+    std::size_t queue_size = 8192;
+    std::size_t thread_count = 1;
+    spdlog::async_overflow_policy overflow_policy = spdlog::async_overflow_policy::block;
+
+    Sink sink = Sink::console;
+    // File sinks only
+    std::string file_path = "grpc_mock_server.log";
+    std::size_t max_file_size = 16 * 1024 * 1024;
+    std::size_t max_files = 3;
+
+    spdlog::level::level_enum level = spdlog::level::trace;
+};
+
+// Synchronous console logger at trace level
 GRPC_MOCK_SERVER_LIBRARY_API bool initLogLibrary();
+GRPC_MOCK_SERVER_LIBRARY_API bool initLogLibrary(const LogSettings& settings);
 GRPC_MOCK_SERVER_LIBRARY_API void deinitLogLibrary();
 
 }
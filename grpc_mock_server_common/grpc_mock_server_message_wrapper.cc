@@ -17,10 +17,12 @@
  */
 
 #include "grpc_mock_server_message_wrapper.h"
+#include "grpc_mock_server_request_language.h"
+#include "grpc_mock_server_override_program.h"
 
-#include <regex>
-#include <ranges>
-#include <peglib.h>
+#include <google/protobuf/reflection.h>
+
+#include <algorithm>
 
 std::string MessageWrapper::getBooleanValueAsString(
     const google::protobuf::Message* message,
@@ -166,7 +168,7 @@ void MessageWrapper::setEnumValue(
     google::protobuf::Message* message,
     const google::protobuf::FieldDescriptor* field_descriptor,
     const google::protobuf::Reflection* reflection,
-    const std::string& value_string
+    std::string_view value_string
 ) {
     int value_int{ -1 };
 
@@ -374,16 +376,198 @@ void MessageWrapper::setStringValue(
     google::protobuf::Message* message,
     const google::protobuf::FieldDescriptor* field_descriptor,
     const google::protobuf::Reflection* reflection,
-    const std::string& value_string
+    std::string_view value_string
 ) {
     if (field_descriptor->is_repeated()) {
         int repeated_message_count = reflection->FieldSize(*message, field_descriptor);
         for (int i = 0; i < repeated_message_count; i++) {
-            reflection->SetRepeatedString(message, field_descriptor, i, value_string);
+            reflection->SetRepeatedString(message, field_descriptor, i, std::string(value_string));
         }
     }
     else {
-        reflection->SetString(message, field_descriptor, value_string);
+        reflection->SetString(message, field_descriptor, std::string(value_string));
+    }
+}
+
+bool MessageWrapper::ArrayView::operator==(const ArrayView& other) const {
+    return std::ranges::equal(items, other.items);
+}
+
+auto MessageWrapper::toValueView(const ValueWrapper& value, std::vector<ValueView>& array_items) -> ValueView {
+    return std::visit([&array_items](const auto& item) -> ValueView {
+        using ItemType = std::decay_t<decltype(item)>;
+        if constexpr (std::is_same_v<ItemType, std::string>) {
+            return std::string_view(item);
+        }
+        else if constexpr (std::is_same_v<ItemType, EnumWrapper>) {
+            return EnumView(item.name);
+        }
+        else if constexpr (std::is_same_v<ItemType, ArrayWrapper>) {
+            // Items are scalars, so the nested call never touches array_items
+            array_items.clear();
+            array_items.reserve(item.items.size());
+            for (const auto& array_item : item.items) {
+                array_items.push_back(toValueView(array_item, array_items));
+            }
+            return ArrayView(array_items);
+        }
+        else {
+            return item;
+        }
+    }, value);
+}
+
+auto MessageWrapper::toValueWrapper(const ValueView& value) -> ValueWrapper {
+    return std::visit([](const auto& item) -> ValueWrapper {
+        using ItemType = std::decay_t<decltype(item)>;
+        if constexpr (std::is_same_v<ItemType, std::string_view>) {
+            return std::string(item);
+        }
+        else if constexpr (std::is_same_v<ItemType, EnumView>) {
+            return EnumWrapper(std::string(item.name));
+        }
+        else if constexpr (std::is_same_v<ItemType, ArrayView>) {
+            ArrayWrapper result;
+            result.items.reserve(item.items.size());
+            for (const auto& array_item : item.items) {
+                result.items.push_back(toValueWrapper(array_item));
+            }
+            return result;
+        }
+        else {
+            return item;
+        }
+    }, value);
+}
+
+namespace {
+
+// Numeric array items may be written both as integer and floating point literals
+double arrayItemToDouble(const MessageWrapper::ValueView& item) {
+    if (std::holds_alternative<int64_t>(item)) {
+        return static_cast<double>(std::get<int64_t>(item));
+    }
+    assert(std::holds_alternative<double>(item));
+    return std::get<double>(item);
+}
+
+int64_t arrayItemToInt64(const MessageWrapper::ValueView& item) {
+    assert(std::holds_alternative<int64_t>(item));
+    return std::get<int64_t>(item);
+}
+
+// Unsigned fields do not take negative literals, the field is left unchanged then
+bool checkUnsignedItems(const google::protobuf::FieldDescriptor* field_descriptor, std::span<const MessageWrapper::ValueView> items) {
+    for (const auto& item : items) {
+        if (arrayItemToInt64(item) < 0) {
+            std::cout << "ERROR: negative value " << std::get<int64_t>(item) << " for unsigned field " << field_descriptor->full_name() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Scalar and string repeated fields: the elements are replaced through the typed reference, without reflection per element
+template <typename T, typename Convert>
+void assignRepeatedField(
+    google::protobuf::Message* message,
+    const google::protobuf::FieldDescriptor* field_descriptor,
+    const google::protobuf::Reflection* reflection,
+    std::span<const MessageWrapper::ValueView> items,
+    Convert convert
+) {
+    auto repeated_field = reflection->GetMutableRepeatedFieldRef<T>(message, field_descriptor);
+    repeated_field.Clear();
+    for (const auto& item : items) {
+        repeated_field.Add(convert(item));
+    }
+}
+
+} // anonymous namespace
+
+void MessageWrapper::setArrayValue(
+    google::protobuf::Message* message,
+    const google::protobuf::FieldDescriptor* field_descriptor,
+    const google::protobuf::Reflection* reflection,
+    const ArrayView& value
+) {
+    const auto& items = value.items;
+    switch (field_descriptor->cpp_type()) {
+    case google::protobuf::FieldDescriptor::CPPTYPE_BOOL: {
+        assignRepeatedField<bool>(message, field_descriptor, reflection, items, [](const ValueView& item) {
+            assert(std::holds_alternative<bool>(item));
+            return std::get<bool>(item);
+        });
+        break;
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_FLOAT: {
+        assignRepeatedField<float>(message, field_descriptor, reflection, items, [](const ValueView& item) {
+            return static_cast<float>(arrayItemToDouble(item));
+        });
+        break;
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_DOUBLE: {
+        assignRepeatedField<double>(message, field_descriptor, reflection, items, arrayItemToDouble);
+        break;
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_INT32: {
+        assignRepeatedField<int32_t>(message, field_descriptor, reflection, items, [](const ValueView& item) {
+            return static_cast<int32_t>(arrayItemToInt64(item));
+        });
+        break;
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_INT64: {
+        assignRepeatedField<int64_t>(message, field_descriptor, reflection, items, arrayItemToInt64);
+        break;
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_UINT32: {
+        if (!checkUnsignedItems(field_descriptor, items)) {
+            break;
+        }
+        assignRepeatedField<uint32_t>(message, field_descriptor, reflection, items, [](const ValueView& item) {
+            return static_cast<uint32_t>(arrayItemToInt64(item));
+        });
+        break;
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_UINT64: {
+        if (!checkUnsignedItems(field_descriptor, items)) {
+            break;
+        }
+        assignRepeatedField<uint64_t>(message, field_descriptor, reflection, items, [](const ValueView& item) {
+            return static_cast<uint64_t>(arrayItemToInt64(item));
+        });
+        break;
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_ENUM: {
+        // Enum fields are not supported by the typed repeated field references
+        auto enum_descriptor = field_descriptor->enum_type();
+        reflection->ClearField(message, field_descriptor);
+        for (const auto& item : items) {
+            assert(std::holds_alternative<EnumView>(item) || std::holds_alternative<std::string_view>(item));
+            std::string_view value_string = std::holds_alternative<EnumView>(item)
+                ? std::get<EnumView>(item).name
+                : std::get<std::string_view>(item);
+
+            auto enum_value_descriptor = enum_descriptor->FindValueByName(std::string(value_string));
+            if (enum_value_descriptor == nullptr) {
+                std::cout << "ERROR: invalid enum value " << value_string << std::endl;
+                enum_value_descriptor = enum_descriptor->value(0);
+            }
+            reflection->AddEnumValue(message, field_descriptor, enum_value_descriptor->number());
+        }
+        break;
+    }
+    case google::protobuf::FieldDescriptor::CPPTYPE_STRING: {
+        assignRepeatedField<std::string>(message, field_descriptor, reflection, items, [](const ValueView& item) {
+            assert(std::holds_alternative<std::string_view>(item));
+            return std::string(std::get<std::string_view>(item));
+        });
+        break;
+    }
+    default: {
+        std::cout << "ERROR: arrays of messages are not supported, field " << field_descriptor->full_name() << " is left unchanged" << std::endl;
+        break;
+    }
     }
 }
 
@@ -393,6 +577,22 @@ void MessageWrapper::setValue(
     const google::protobuf::Reflection* reflection,
     const ValueWrapper& value
 ) {
+    std::vector<ValueView> array_items;
+    setValue(message, field_descriptor, reflection, toValueView(value, array_items));
+}
+
+void MessageWrapper::setValue(
+    google::protobuf::Message* message,
+    const google::protobuf::FieldDescriptor* field_descriptor,
+    const google::protobuf::Reflection* reflection,
+    const ValueView& value
+) {
+    if (std::holds_alternative<ArrayView>(value)) {
+        assert(field_descriptor->is_repeated());
+        setArrayValue(message, field_descriptor, reflection, std::get<ArrayView>(value));
+        return;
+    }
+
     switch (field_descriptor->type()) {
     case google::protobuf::FieldDescriptor::TYPE_BOOL: {
         assert(std::holds_alternative<bool>(value));
@@ -416,8 +616,11 @@ void MessageWrapper::setValue(
         break;
     }
     case google::protobuf::FieldDescriptor::TYPE_ENUM: {
-        assert(std::holds_alternative<std::string>(value));
-        std::string value_string = std::get<std::string>(value);
+        // The language yields enumerators as EnumView, string literals are accepted as well
+        assert(std::holds_alternative<EnumView>(value) || std::holds_alternative<std::string_view>(value));
+        std::string_view value_string = std::holds_alternative<EnumView>(value)
+            ? std::get<EnumView>(value).name
+            : std::get<std::string_view>(value);
 
         setEnumValue(message, field_descriptor, reflection, value_string);
         break;
@@ -452,8 +655,8 @@ void MessageWrapper::setValue(
         break;
     }
     case google::protobuf::FieldDescriptor::TYPE_STRING: {
-        assert(std::holds_alternative<std::string>(value));
-        std::string value_string = std::get<std::string>(value);
+        assert(std::holds_alternative<std::string_view>(value));
+        std::string_view value_string = std::get<std::string_view>(value);
 
         setStringValue(message, field_descriptor, reflection, value_string);
         break;
@@ -507,226 +710,39 @@ std::string MessageWrapper::getValueString(
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-std::string MessageWrapper::normalizePathToken(const std::string& current_path_token_raw, const bool is_repeated) {
-    std::string current_path_token = current_path_token_raw;
-    if (is_repeated) {
-        current_path_token = current_path_token_raw.substr(0, current_path_token_raw.size() - 2);
-    }
-    return current_path_token;
-}
-
-std::vector<MessageWrapper::MessageData> MessageWrapper::getMockDataRequestMessages(
-    const google::protobuf::Message& input_message,
-    const RequestWithValue& request
-) {
-    std::vector<MessageWrapper::MessageData> result;
-
-    auto* input_message_copy = const_cast<google::protobuf::Message*>(&input_message);
-    std::vector<MessageWrapper::MessageData> current_messages{
-        MessageWrapper::MessageData(input_message_copy, input_message_copy->GetDescriptor(), input_message_copy->GetReflection())
-    };
-
-    for (const auto& current_path_token_raw : request.first) {
-        bool is_repeated = current_path_token_raw.ends_with("[]");
-        std::string current_path_token = normalizePathToken(current_path_token_raw, is_repeated);
-
-        std::vector<MessageWrapper::MessageData> temp_messages;
-        for (auto& current_message_data : current_messages) {
-            current_message_data.field_descriptor = current_message_data.descriptor->FindFieldByName(current_path_token);
-            assert(is_repeated == current_message_data.field_descriptor->is_repeated());
-            if (is_repeated) {
-                int repeated_message_count = current_message_data.reflection->FieldSize(
-                    *current_message_data.message,
-                    current_message_data.field_descriptor
-                );
-
-                for (int i = 0; i < repeated_message_count; i++) {
-                    auto repeated_message = current_message_data.reflection->MutableRepeatedMessage(
-                        current_message_data.message,
-                        current_message_data.field_descriptor,
-                        i
-                    );
-                    auto repeated_message_descriptor = repeated_message->GetDescriptor();
-                    auto repeated_message_reflection = repeated_message->GetReflection();
-                    temp_messages.push_back(
-                        MessageWrapper::MessageData(
-                            repeated_message,
-                            repeated_message_descriptor,
-                            repeated_message_reflection
-                        )
-                    );
-                }
-            }
-            else {
-                if (current_path_token == request.first.back()) {
-                    result = current_messages;
-                }
-                else {
-                    auto temp_message = current_message_data.reflection->MutableMessage(
-                        current_message_data.message,
-                        current_message_data.field_descriptor
-                    );
-                    auto temp_message_descriptor = temp_message->GetDescriptor();
-                    auto temp_message_reflection = temp_message->GetReflection();
-                    temp_messages.push_back(
-                        MessageWrapper::MessageData(temp_message, temp_message_descriptor, temp_message_reflection)
-                    );
-                }
-            }
-        }
-        temp_messages.swap(current_messages);
-    }
-
-    return result;
+auto MessageWrapper::parse(const RequestLanguage& language, const std::string& program) -> std::optional<std::vector<RequestWithValue>> {
+    return language.parse(program);
 }
 
 auto MessageWrapper::parse(const std::string& grammar, const std::string& program) -> std::optional<std::vector<RequestWithValue>> {
-    peg::parser parser(grammar);
-    assert(static_cast<bool>(parser) == true);
-
-    parser["program"] = [](const peg::SemanticValues& vs) {
-        std::vector<RequestWithValue> result;
-        for (int i = 0; i < vs.size(); i++) {
-            RequestWithValue value = std::any_cast<RequestWithValue>(vs[i]);
-            result.push_back(value);
-        }
-        return result;
-    };
-
-    parser["statement"] = [](const peg::SemanticValues& vs) {
-        // Request
-        std::vector <std::string> request_path;
-        if (vs[0].type().hash_code() == typeid(std::vector<std::string>).hash_code()) {
-            request_path = std::any_cast<std::vector<std::string>>(vs[0]);
-            std::string result;
-            for (int i = 0; i < request_path.size(); i++) {
-                result += request_path[i];
-                if (i != request_path.size() - 1) {
-                    result += ".";
-                }
-            }
-            result = std::regex_replace(result, std::regex{ R"(^\s+|\s+$)" }, "");
-        }
-        else {
-            assert(0);
-        }
-
-        // Value
-        ValueWrapper value;
-        // null
-        if (vs[1].type().hash_code() == typeid(nullptr).hash_code()) {
-            value = nullptr;
-            assert(std::holds_alternative<std::nullptr_t>(value));
-            assert(std::get<std::nullptr_t>(value) == nullptr);
-        }
-        // boolean
-        else if (vs[1].type().hash_code() == typeid(bool).hash_code()) {
-            bool boolean_value = std::any_cast<bool>(vs[1]);
-            value = boolean_value;
-            assert(std::holds_alternative<bool>(value));
-            assert(std::get<bool>(value) == boolean_value);
-        }
-        // number (int)
-        else if (vs[1].type().hash_code() == typeid(int).hash_code()) {
-            int int_value = std::any_cast<int>(vs[1]);
-            value = int_value;
-            assert(std::holds_alternative<int64_t>(value));
-            assert(std::get<int64_t>(value) == int_value);
-        }
-        // number (double)
-        else if (vs[1].type().hash_code() == typeid(double).hash_code()) {
-            double double_value = std::any_cast<double>(vs[1]);
-            value = double_value;
-            assert(std::holds_alternative<double>(value));
-            assert(std::get<double>(value) == double_value);
-        }
-        // string
-        else if (vs[1].type().hash_code() == typeid(std::string).hash_code()) {
-            std::string string_value = std::any_cast<std::string>(vs[1]);
-            value = string_value;
-            assert(std::holds_alternative<std::string>(value));
-            assert(std::get<std::string>(value) == string_value);
-        }
-        // enum
-        else if (vs[1].type().hash_code() == typeid(EnumWrapper).hash_code()) {
-            EnumWrapper wrapper_value = std::any_cast<EnumWrapper>(vs[1]);
-            value = wrapper_value;
-            assert(std::holds_alternative<EnumWrapper>(value));
-            assert(std::get<EnumWrapper>(value).name == wrapper_value.name);
-        }
-        else {
-            assert(0);
-        }
-        return RequestWithValue(request_path, value);
-    };
-
-    parser["request"] = [](const peg::SemanticValues& vs) {
-        std::vector<std::string> result;
-        for (int i = 0; i < vs.size(); i++) {
-            result.push_back(std::any_cast<std::string>(vs[i]));
-        }
-        return result;
-        };
-
-    parser["ident"] = [](const peg::SemanticValues& vs) {
-        return vs.token_to_string();
-        };
-
-    parser["null"] = [](const peg::SemanticValues& vs) {
-        return nullptr;
-        };
-
-    parser["boolean"] = [](const peg::SemanticValues& vs) {
-        // Case-insensitive compare with "true" string
-        std::string value_string = vs.token_to_string();
-        bool value_boolean = std::ranges::equal(
-            value_string,
-            std::string("true"), [value_string](unsigned char a, unsigned char b) {
-                return std::tolower(a) == std::tolower(b);
-            }
-        );
-        return value_boolean;
-        };
-
-    parser["float"] = [](const peg::SemanticValues& vs) {
-        auto s = vs.token_to_number<double>();
-        return s;
-        };
-
-    parser["int"] = [](const peg::SemanticValues& vs) {
-        auto s = vs.token_to_number<int>();
-        return s;
-        };
-
-    parser["string"] = [](const peg::SemanticValues& vs) {
-        auto s = vs.token_to_string();
-        return s;
-        };
-
-    parser["enum"] = [](const peg::SemanticValues& vs) {
-        auto s = vs.token_to_string();
-        return EnumWrapper(s);
-        };
-
-    parser.enable_packrat_parsing();
-
-    std::vector<RequestWithValue> result;
-    bool parse_result = parser.parse(program, result);
-    return parse_result ? std::optional<std::vector<RequestWithValue>>(result) : std::nullopt;
+    // NOTE: compiles the grammar on every call, use the RequestLanguage overload on hot paths
+    return parse(RequestLanguage(grammar), program);
 }
 
 void MessageWrapper::eval(const google::protobuf::Message& root_message, const std::string& grammar, const std::string& program) {
-    auto request_with_value_collection_opt = parse(grammar, program);
-    if (!request_with_value_collection_opt.has_value()) {
+    eval(root_message, RequestLanguage(grammar), program);
+}
+
+void MessageWrapper::eval(const google::protobuf::Message& root_message, const RequestLanguage& language, const std::string& program) {
+    auto compiled_program = compile(language, program);
+    if (!compiled_program) {
         assert(false);
         return;
     }
 
-    const auto& request_with_value_collection = request_with_value_collection_opt.value();
-    for (const auto& request_with_value : request_with_value_collection) {
-        auto messages = getMockDataRequestMessages(root_message, request_with_value);
-        for (const auto& message_data : messages) {
-            setValue(message_data.message, message_data.field_descriptor, message_data.reflection, request_with_value.second);
-        }
+    eval(root_message, *compiled_program);
+}
+
+auto MessageWrapper::compile(const RequestLanguage& language, std::string program) -> std::shared_ptr<const CompiledOverrideProgram> {
+    auto request_program_opt = language.parseProgram(std::move(program));
+    if (!request_program_opt.has_value()) {
+        return nullptr;
     }
+    return std::make_shared<const CompiledOverrideProgram>(std::move(request_program_opt.value()));
+}
+
+void MessageWrapper::eval(const google::protobuf::Message& root_message, const CompiledOverrideProgram& program) {
+    auto* root_message_copy = const_cast<google::protobuf::Message*>(&root_message);
+    bool apply_result = program.apply(*root_message_copy);
+    assert(apply_result);
 }
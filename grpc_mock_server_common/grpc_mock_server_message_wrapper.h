@@ -24,8 +24,14 @@
 #include <grpc++/grpc++.h>
 #include <google/protobuf/message.h>
 
+#include <memory>
+#include <span>
+#include <string_view>
 #include <variant>
 
+class RequestLanguage;
+class CompiledOverrideProgram;
+
 class GRPC_MOCK_SERVER_LIBRARY_API MessageWrapper {
     static std::string getBooleanValueAsString(
         const google::protobuf::Message* message,
@@ -76,7 +82,7 @@ class GRPC_MOCK_SERVER_LIBRARY_API MessageWrapper {
         google::protobuf::Message* message,
         const google::protobuf::FieldDescriptor* field_descriptor,
         const google::protobuf::Reflection* reflection,
-        const std::string& value_string
+        std::string_view value_string
     );
 
     static std::string getInt32ValueAsString(
@@ -141,21 +147,33 @@ class GRPC_MOCK_SERVER_LIBRARY_API MessageWrapper {
         google::protobuf::Message* message,
         const google::protobuf::FieldDescriptor* field_descriptor,
         const google::protobuf::Reflection* reflection,
-        const std::string& value
+        std::string_view value
     );
 
 public:
     struct EnumWrapper;
+    struct EnumView;
+    struct ArrayWrapper;
+    struct ArrayView;
     struct MessageData;
 
-    using ValueWrapper = std::variant<std::nullptr_t, bool, double, int64_t, std::string, EnumWrapper>;
+    using ValueWrapper = std::variant<std::nullptr_t, bool, double, int64_t, std::string, EnumWrapper, ArrayWrapper>;
     using RequestWithValue = std::pair<std::vector<std::string>, ValueWrapper>;
 
+    // Non-owning value, strings point into the program text
+    using ValueView = std::variant<std::nullptr_t, bool, double, int64_t, std::string_view, EnumView, ArrayView>;
+
+    // Array items of the view are stored in array_items
+    static ValueView toValueView(const ValueWrapper& value, std::vector<ValueView>& array_items);
+    static ValueWrapper toValueWrapper(const ValueView& value);
+
 private:
-    static std::string normalizePathToken(const std::string& current_path_token_raw, const bool is_repeated);
-    static std::vector<MessageData> getMockDataRequestMessages(
-        const google::protobuf::Message& input_message,
-        const RequestWithValue& request
+    // Replace the content of the repeated field with the array items in one bulk operation
+    static void setArrayValue(
+        google::protobuf::Message* message,
+        const google::protobuf::FieldDescriptor* field_descriptor,
+        const google::protobuf::Reflection* reflection,
+        const ArrayView& value
     );
 
 public:
@@ -166,17 +184,50 @@ public:
         const ValueWrapper& value
     );
 
+    static void setValue(
+        google::protobuf::Message* message,
+        const google::protobuf::FieldDescriptor* field_descriptor,
+        const google::protobuf::Reflection* reflection,
+        const ValueView& value
+    );
+
     static std::string getValueString(
         google::protobuf::Message* message,
         const google::protobuf::FieldDescriptor* field_descriptor,
         const google::protobuf::Reflection* reflection
     );
 
+    static auto parse(const RequestLanguage& language, const std::string& program) -> std::optional<std::vector<RequestWithValue>>;
+    static void eval(const google::protobuf::Message& root_message, const RequestLanguage& language, const std::string& program);
+
+    // Parse the program once and apply the result to any number of messages; nullptr on syntax error
+    static auto compile(const RequestLanguage& language, std::string program) -> std::shared_ptr<const CompiledOverrideProgram>;
+    static void eval(const google::protobuf::Message& root_message, const CompiledOverrideProgram& program);
+
+    // Compile the grammar on every call; kept for compatibility
     static auto parse(const std::string& grammar, const std::string& program) -> std::optional<std::vector<RequestWithValue>>;
     static void eval(const google::protobuf::Message& root_message, const std::string& grammar, const std::string& program);
 
 public:
-    struct EnumWrapper { std::string name; };
+    struct EnumWrapper {
+        std::string name;
+        bool operator==(const EnumWrapper&) const = default;
+    };
+
+    struct EnumView {
+        std::string_view name;
+        bool operator==(const EnumView&) const = default;
+    };
+
+    struct ArrayWrapper {
+        std::vector<ValueWrapper> items;
+        bool operator==(const ArrayWrapper&) const = default;
+    };
+
+    struct ArrayView {
+        std::span<const ValueView> items;
+        bool operator==(const ArrayView& other) const;
+    };
 
     struct MockDataRequest {
         std::vector<std::string> mock_path_tokens;
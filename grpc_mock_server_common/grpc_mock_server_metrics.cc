@@ -0,0 +1,435 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "grpc_mock_server_metrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Shards are handed out to the threads round robin on their first record
+std::atomic<std::size_t> next_shard = 0;
+
+void writeLabelValue(std::ostream& output, std::string_view value) {
+    for (auto c : value) {
+        switch (c) {
+            case '\\': {
+                output << "\\\\";
+                break;
+            }
+            case '"': {
+                output << "\\\"";
+                break;
+            }
+            case '\n': {
+                output << "\\n";
+                break;
+            }
+            default: {
+                output << c;
+                break;
+            }
+        }
+    }
+}
+
+void writeSeconds(std::ostream& output, std::uint64_t value_ns) {
+    output << std::setprecision(9) << static_cast<double>(value_ns) / 1e9;
+}
+
+} // anonymous namespace
+
+auto MethodMetrics::Histogram::percentile(double fraction) const -> std::chrono::nanoseconds {
+    if (m_count == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+
+    auto target = std::clamp<std::uint64_t>(static_cast<std::uint64_t>(std::ceil(fraction * m_count)), 1, m_count);
+    std::uint64_t cumulative_count = 0;
+    for (std::size_t i = 0; i < m_buckets.size(); i++) {
+        cumulative_count += m_buckets[i];
+        if (cumulative_count >= target) {
+            return std::chrono::nanoseconds(bucketUpperBound(i));
+        }
+    }
+    return std::chrono::nanoseconds(bucketUpperBound(m_buckets.size() - 1));
+}
+
+MethodMetrics::MethodMetrics(std::string name)
+    : m_name(std::move(name)) {
+}
+
+auto MethodMetrics::name() const -> const std::string& {
+    return m_name;
+}
+
+void MethodMetrics::recordCall(bool ok) {
+    auto& current_shard = shard();
+    current_shard.m_call_count.fetch_add(1, std::memory_order_relaxed);
+    if (!ok) {
+        current_shard.m_error_count.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void MethodMetrics::recordStage(Stage stage, std::chrono::nanoseconds duration) {
+    auto value_ns = static_cast<std::uint64_t>(std::max<std::int64_t>(duration.count(), 0));
+    auto& stage_shard = shard().m_stages[static_cast<std::size_t>(stage)];
+    stage_shard.m_buckets[bucketIndex(value_ns)].fetch_add(1, std::memory_order_relaxed);
+    stage_shard.m_sum_ns.fetch_add(value_ns, std::memory_order_relaxed);
+    stage_shard.m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::uint64_t MethodMetrics::callCount() const {
+    std::uint64_t result = 0;
+    for (const auto& current_shard : m_shards) {
+        result += current_shard.m_call_count.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+std::uint64_t MethodMetrics::errorCount() const {
+    std::uint64_t result = 0;
+    for (const auto& current_shard : m_shards) {
+        result += current_shard.m_error_count.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+auto MethodMetrics::histogram(Stage stage) const -> Histogram {
+    Histogram result;
+    result.m_buckets.resize(kBucketCount);
+    for (const auto& current_shard : m_shards) {
+        const auto& stage_shard = current_shard.m_stages[static_cast<std::size_t>(stage)];
+        for (std::size_t i = 0; i < kBucketCount; i++) {
+            result.m_buckets[i] += stage_shard.m_buckets[i].load(std::memory_order_relaxed);
+        }
+        result.m_sum_ns += stage_shard.m_sum_ns.load(std::memory_order_relaxed);
+    }
+    // Count is the bucket total, so a scrape racing with the writers is still consistent
+    for (auto bucket_count : result.m_buckets) {
+        result.m_count += bucket_count;
+    }
+    return result;
+}
+
+auto MethodMetrics::stageName(Stage stage) -> std::string_view {
+    switch (stage) {
+        case Stage::load: {
+            return "load";
+        }
+        case Stage::override_apply: {
+            return "override_apply";
+        }
+        case Stage::serialize: {
+            return "serialize";
+        }
+        case Stage::log: {
+            return "log";
+        }
+        default: {
+            return "unknown";
+        }
+    }
+}
+
+auto MethodMetrics::bucketIndex(std::uint64_t value_ns) -> std::size_t {
+    if (value_ns < kSubBucketCount) {
+        return static_cast<std::size_t>(value_ns);
+    }
+
+    // Top bit selects the power of two, the next kSubBucketBits bits select the linear sub-bucket
+    std::size_t top_bit = std::bit_width(value_ns) - 1;
+    if (top_bit >= kMaxValueBits) {
+        return kOverflowBucket;
+    }
+    auto sub_bucket = static_cast<std::size_t>(value_ns >> (top_bit - kSubBucketBits)) & (kSubBucketCount - 1);
+    return (top_bit - kSubBucketBits + 1) * kSubBucketCount + sub_bucket;
+}
+
+auto MethodMetrics::bucketUpperBound(std::size_t index) -> std::uint64_t {
+    if (index < kSubBucketCount) {
+        return index;
+    }
+    if (index >= kOverflowBucket) {
+        return std::numeric_limits<std::uint64_t>::max();
+    }
+
+    auto shift = index / kSubBucketCount - 1;
+    auto lower_bound = static_cast<std::uint64_t>(kSubBucketCount + index % kSubBucketCount) << shift;
+    return lower_bound + (std::uint64_t(1) << shift) - 1;
+}
+
+auto MethodMetrics::shard() -> Shard& {
+    thread_local std::size_t shard_index = next_shard.fetch_add(1, std::memory_order_relaxed) % kShardCount;
+    return m_shards[shard_index];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+StageTimer::StageTimer(MethodMetrics* metrics, MethodMetrics::Stage stage)
+    : m_metrics(metrics), m_stage(stage) {
+    if (m_metrics != nullptr) {
+        m_start = std::chrono::steady_clock::now();
+    }
+}
+
+StageTimer::~StageTimer() {
+    if (m_metrics != nullptr) {
+        m_metrics->recordStage(m_stage, std::chrono::steady_clock::now() - m_start);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MetricsRegistry::MetricsRegistry() = default;
+
+MetricsRegistry::~MetricsRegistry() = default;
+
+MetricsRegistry& MetricsRegistry::instance() {
+    static MetricsRegistry instance;
+    return instance;
+}
+
+auto MetricsRegistry::method(std::string_view method_name) -> MethodMetrics* {
+    std::lock_guard lock(m_mutex);
+    auto it = m_methods.find(method_name);
+    if (it == m_methods.end()) {
+        auto metrics = std::make_unique<MethodMetrics>(std::string(method_name));
+        it = m_methods.emplace(metrics->name(), std::move(metrics)).first;
+    }
+    return it->second.get();
+}
+
+auto MetricsRegistry::find(std::string_view method_name) const -> const MethodMetrics* {
+    std::lock_guard lock(m_mutex);
+    auto it = m_methods.find(method_name);
+    return it != m_methods.end() ? it->second.get() : nullptr;
+}
+
+auto MetricsRegistry::methods() const -> std::vector<const MethodMetrics*> {
+    std::lock_guard lock(m_mutex);
+    std::vector<const MethodMetrics*> result;
+    result.reserve(m_methods.size());
+    for (const auto& [name, metrics] : m_methods) {
+        result.push_back(metrics.get());
+    }
+    return result;
+}
+
+auto MetricsRegistry::renderPrometheus() const -> std::string {
+    auto all_methods = methods();
+    std::ostringstream output;
+
+    output << "# HELP grpc_mock_server_calls_total Mocked calls served per method.\n";
+    output << "# TYPE grpc_mock_server_calls_total counter\n";
+    for (const auto* metrics : all_methods) {
+        output << "grpc_mock_server_calls_total{method=\"";
+        writeLabelValue(output, metrics->name());
+        output << "\"} " << metrics->callCount() << "\n";
+    }
+
+    output << "# HELP grpc_mock_server_call_errors_total Mocked calls finished with an error status per method.\n";
+    output << "# TYPE grpc_mock_server_call_errors_total counter\n";
+    for (const auto* metrics : all_methods) {
+        output << "grpc_mock_server_call_errors_total{method=\"";
+        writeLabelValue(output, metrics->name());
+        output << "\"} " << metrics->errorCount() << "\n";
+    }
+
+    output << "# HELP grpc_mock_server_stage_duration_seconds Time spent in the mock handling stages per method.\n";
+    output << "# TYPE grpc_mock_server_stage_duration_seconds histogram\n";
+    for (const auto* metrics : all_methods) {
+        for (std::size_t stage_index = 0; stage_index < MethodMetrics::kStageCount; stage_index++) {
+            auto stage = static_cast<MethodMetrics::Stage>(stage_index);
+            auto histogram = metrics->histogram(stage);
+            if (histogram.m_count == 0) {
+                continue;
+            }
+
+            auto write_labels = [&] {
+                output << "{method=\"";
+                writeLabelValue(output, metrics->name());
+                output << "\",stage=\"" << MethodMetrics::stageName(stage) << "\"";
+            };
+
+            // Only the last sub-bucket of every power of two is listed, the overflow bucket is counted in +Inf only
+            std::uint64_t cumulative_count = 0;
+            for (std::size_t i = 0; i < MethodMetrics::kRegularBucketCount; i++) {
+                cumulative_count += histogram.m_buckets[i];
+                if ((i + 1) % MethodMetrics::kSubBucketCount != 0) {
+                    continue;
+                }
+                output << "grpc_mock_server_stage_duration_seconds_bucket";
+                write_labels();
+                output << ",le=\"";
+                writeSeconds(output, MethodMetrics::bucketUpperBound(i));
+                output << "\"} " << cumulative_count << "\n";
+            }
+            output << "grpc_mock_server_stage_duration_seconds_bucket";
+            write_labels();
+            output << ",le=\"+Inf\"} " << histogram.m_count << "\n";
+
+            output << "grpc_mock_server_stage_duration_seconds_sum";
+            write_labels();
+            output << "} ";
+            writeSeconds(output, histogram.m_sum_ns);
+            output << "\n";
+
+            output << "grpc_mock_server_stage_duration_seconds_count";
+            write_labels();
+            output << "} " << histogram.m_count << "\n";
+        }
+    }
+
+    return output.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MetricsHttpServer::MetricsHttpServer(MetricsRegistry& registry)
+    : m_registry(registry) {
+}
+
+MetricsHttpServer::~MetricsHttpServer() {
+    stop();
+}
+
+bool MetricsHttpServer::start(int port) {
+    stop();
+
+#if defined(_WIN32) || defined(_WIN64)
+    std::cout << "ERROR: metrics HTTP server is not supported on Windows" << std::endl;
+    return false;
+#else
+    int listen_socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_socket < 0) {
+        std::cout << "ERROR: unable to create the metrics socket" << std::endl;
+        return false;
+    }
+    int reuse_address = 1;
+    ::setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse_address, sizeof(reuse_address));
+
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<std::uint16_t>(port));
+    socklen_t address_size = sizeof(address);
+    if (::bind(listen_socket, reinterpret_cast<sockaddr*>(&address), address_size) != 0
+        || ::listen(listen_socket, 16) != 0
+        || ::getsockname(listen_socket, reinterpret_cast<sockaddr*>(&address), &address_size) != 0) {
+        std::cout << "ERROR: unable to listen for metrics on port " << port << std::endl;
+        ::close(listen_socket);
+        return false;
+    }
+
+    m_socket = listen_socket;
+    m_port = ntohs(address.sin_port);
+    m_thread = std::jthread([this](std::stop_token stop_token) { run(stop_token); });
+    return true;
+#endif
+}
+
+void MetricsHttpServer::stop() {
+    if (m_thread.joinable()) {
+        m_thread.request_stop();
+        m_thread.join();
+    }
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (m_socket >= 0) {
+        ::close(m_socket);
+    }
+#endif
+    m_socket = -1;
+    m_port = 0;
+}
+
+int MetricsHttpServer::port() const {
+    return m_port;
+}
+
+void MetricsHttpServer::run(std::stop_token stop_token) {
+#if !defined(_WIN32) && !defined(_WIN64)
+    while (!stop_token.stop_requested()) {
+        // Short poll timeout lets stop() finish without closing the socket under accept()
+        pollfd listen_poll { m_socket, POLLIN, 0 };
+        if (::poll(&listen_poll, 1, 100) <= 0) {
+            continue;
+        }
+        int connection = ::accept(m_socket, nullptr, nullptr);
+        if (connection < 0) {
+            continue;
+        }
+        respond(connection);
+        ::close(connection);
+    }
+#endif
+}
+
+void MetricsHttpServer::respond(int connection) {
+#if !defined(_WIN32) && !defined(_WIN64)
+    timeval timeout { 1, 0 };
+    ::setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // Only the request line matters, the headers are read to keep the client from getting a reset
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+        auto read_size = ::recv(connection, buffer, sizeof(buffer), 0);
+        if (read_size <= 0) {
+            break;
+        }
+        request.append(buffer, static_cast<std::size_t>(read_size));
+    }
+
+    std::string status = "404 Not Found";
+    std::string body = "Not Found\n";
+    if (request.starts_with("GET /metrics ") || request.starts_with("GET /metrics?")) {
+        status = "200 OK";
+        body = m_registry.renderPrometheus();
+    }
+
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+        "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n"
+        "\r\n" + body;
+    std::size_t written_size = 0;
+    while (written_size < response.size()) {
+        auto write_size = ::send(connection, response.data() + written_size, response.size() - written_size, MSG_NOSIGNAL);
+        if (write_size <= 0) {
+            break;
+        }
+        written_size += static_cast<std::size_t>(write_size);
+    }
+#endif
+}
@@ -0,0 +1,186 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef GRPC_MOCK_SERVER_METRICS_H
+#define GRPC_MOCK_SERVER_METRICS_H
+
+#include "grpc_mock_server_export.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Call counters and stage latency histograms of a single mocked method.
+// Recording is wait free: every thread updates its own shard with relaxed atomic increments,
+// the shards are merged only when the metrics are read.
+// Histogram buckets are log-linear (HDR style): 8 buckets per power of two of nanoseconds, i.e. within 12.5%
+class GRPC_MOCK_SERVER_LIBRARY_API MethodMetrics {
+public:
+    enum class Stage : std::size_t {
+        load,           // Full response lookup, the file is read and parsed on the first call only
+        override_apply, // Partial override compilation lookup and evaluation
+        serialize,      // Response serialization
+        log,            // Call log callback: JSON rendering and writing
+        count
+    };
+    static constexpr std::size_t kStageCount = static_cast<std::size_t>(Stage::count);
+
+    static constexpr std::size_t kSubBucketBits = 3;
+    static constexpr std::size_t kSubBucketCount = std::size_t(1) << kSubBucketBits;
+    // Values of 2^36 ns (about 68 s) and more are counted in a separate overflow bucket, after the regular ones
+    static constexpr std::size_t kMaxValueBits = 36;
+    static constexpr std::size_t kRegularBucketCount = (kMaxValueBits - kSubBucketBits + 1) * kSubBucketCount;
+    static constexpr std::size_t kOverflowBucket = kRegularBucketCount;
+    static constexpr std::size_t kBucketCount = kRegularBucketCount + 1;
+    static constexpr std::size_t kShardCount = 8;
+
+    struct Histogram {
+        std::vector<std::uint64_t> m_buckets;
+        std::uint64_t m_count = 0;
+        std::uint64_t m_sum_ns = 0;
+
+        // Upper bound of the bucket holding the percentile, fraction is in [0, 1]; zero if nothing is recorded
+        auto percentile(double fraction) const -> std::chrono::nanoseconds;
+    };
+
+private:
+    struct StageShard {
+        std::atomic<std::uint64_t> m_count;
+        std::atomic<std::uint64_t> m_sum_ns;
+        std::array<std::atomic<std::uint64_t>, kBucketCount> m_buckets;
+    };
+    struct alignas(64) Shard {
+        std::atomic<std::uint64_t> m_call_count;
+        std::atomic<std::uint64_t> m_error_count;
+        std::array<StageShard, kStageCount> m_stages;
+    };
+
+    std::string m_name;
+    std::array<Shard, kShardCount> m_shards;
+
+public:
+    explicit MethodMetrics(std::string name);
+
+    // Method key, e.g. "fixed_price_1234.routeguide.RouteGuide/GetFeature"
+    auto name() const -> const std::string&;
+
+    void recordCall(bool ok);
+    void recordStage(Stage stage, std::chrono::nanoseconds duration);
+
+    std::uint64_t callCount() const;
+    std::uint64_t errorCount() const;
+    auto histogram(Stage stage) const -> Histogram;
+
+    static auto stageName(Stage stage) -> std::string_view;
+    static auto bucketIndex(std::uint64_t value_ns) -> std::size_t;
+    // Largest value counted in the bucket
+    static auto bucketUpperBound(std::size_t index) -> std::uint64_t;
+
+private:
+    auto shard() -> Shard&;
+
+    MethodMetrics(const MethodMetrics& root) = delete;
+    MethodMetrics& operator=(const MethodMetrics&) = delete;
+};
+
+// Records the time from construction to destruction, nothing is done if metrics is nullptr:
+//
+//     {
+//         StageTimer timer(metrics, MethodMetrics::Stage::serialize);
+//         response.SerializeToString(&wire_data);
+//     }
+class GRPC_MOCK_SERVER_LIBRARY_API StageTimer {
+    MethodMetrics* m_metrics;
+    MethodMetrics::Stage m_stage;
+    std::chrono::steady_clock::time_point m_start;
+
+public:
+    StageTimer(MethodMetrics* metrics, MethodMetrics::Stage stage);
+    ~StageTimer();
+
+private:
+    StageTimer(const StageTimer& root) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
+
+// Metrics of the methods by Config method key. The registry grows with the config and entries are never removed,
+// so the returned pointers stay valid while the registry is alive.
+// Lookups take a mutex: calls resolve their metrics once per snapshot method, see ConfigSnapshot::methodMetrics()
+class GRPC_MOCK_SERVER_LIBRARY_API MetricsRegistry {
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<MethodMetrics>, std::less<>> m_methods;
+
+public:
+    MetricsRegistry();
+    ~MetricsRegistry();
+
+    static MetricsRegistry& instance();
+
+    // Registers the method on the first call
+    auto method(std::string_view method_name) -> MethodMetrics*;
+    // nullptr if the method is not registered
+    auto find(std::string_view method_name) const -> const MethodMetrics*;
+    // Sorted by name
+    auto methods() const -> std::vector<const MethodMetrics*>;
+
+    // Prometheus text exposition format (version 0.0.4). Histograms list a bucket per power of two of nanoseconds,
+    // so every scrape has the same le values
+    auto renderPrometheus() const -> std::string;
+
+private:
+    MetricsRegistry(const MetricsRegistry& root) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+};
+
+// Serves MetricsRegistry::renderPrometheus() as "GET /metrics" on a local HTTP port, one request per connection.
+// POSIX only, start() fails on Windows
+class GRPC_MOCK_SERVER_LIBRARY_API MetricsHttpServer {
+    MetricsRegistry& m_registry;
+    int m_socket = -1;
+    int m_port = 0;
+    std::jthread m_thread;
+
+public:
+    explicit MetricsHttpServer(MetricsRegistry& registry = MetricsRegistry::instance());
+    ~MetricsHttpServer();
+
+    // Listens on 127.0.0.1, port 0 picks a free one, see port()
+    bool start(int port);
+    void stop();
+    int port() const;
+
+private:
+    void run(std::stop_token stop_token);
+    void respond(int connection);
+
+    MetricsHttpServer(const MetricsHttpServer& root) = delete;
+    MetricsHttpServer& operator=(const MetricsHttpServer&) = delete;
+};
+
+#endif // GRPC_MOCK_SERVER_METRICS_H
@@ -0,0 +1,221 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "grpc_mock_server_override_program.h"
+#include "grpc_mock_server_fs_utils.h"
+#include "grpc_mock_server_wire_patch.h"
+
+#include <mutex>
+
+CompiledOverrideProgram::CompiledOverrideProgram(RequestProgram program)
+    : m_program(std::move(program)) {
+}
+
+const RequestProgram& CompiledOverrideProgram::program() const {
+    return m_program;
+}
+
+bool CompiledOverrideProgram::empty() const {
+    return m_program.statements.empty();
+}
+
+auto CompiledOverrideProgram::bindRequest(
+    const google::protobuf::Descriptor* descriptor,
+    std::span<const std::string_view> path_tokens,
+    const MessageWrapper::ValueView& value
+) -> std::optional<BoundRequest> {
+    if (path_tokens.empty()) {
+        return std::nullopt;
+    }
+
+    auto& typed_fields = TypedFieldRegistry::instance();
+
+    BoundRequest result{ {}, nullptr, &value };
+    result.path.reserve(path_tokens.size() - 1);
+    for (std::size_t i = 0; i < path_tokens.size(); i++) {
+        std::string_view path_token = path_tokens[i];
+        bool is_repeated = path_token.ends_with("[]");
+        if (is_repeated) {
+            path_token.remove_suffix(2);
+        }
+
+        auto field_descriptor = descriptor->FindFieldByName(std::string(path_token));
+        if (field_descriptor == nullptr || field_descriptor->is_repeated() != is_repeated) {
+            return std::nullopt;
+        }
+
+        auto typed_field = is_repeated ? TypedField() : typed_fields.find(descriptor, field_descriptor->number());
+        if (i == path_tokens.size() - 1) {
+            result.field_descriptor = field_descriptor;
+            result.setter = typed_field.setter;
+        }
+        else {
+            if (field_descriptor->cpp_type() != google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+                return std::nullopt;
+            }
+            result.path.push_back(BoundPathStep(field_descriptor, is_repeated, typed_field.mutable_message));
+            descriptor = field_descriptor->message_type();
+        }
+    }
+    return result;
+}
+
+auto CompiledOverrideProgram::bind(const google::protobuf::Descriptor* descriptor) const -> const BoundProgram* {
+    {
+        std::shared_lock lock(m_bound_programs_mutex);
+        auto it = m_bound_programs.find(descriptor);
+        if (it != m_bound_programs.end()) {
+            return it->second.get();
+        }
+    }
+
+    std::unique_ptr<BoundProgram> bound_program = std::make_unique<BoundProgram>();
+    bound_program->reserve(m_program.statements.size());
+    for (const auto& statement : m_program.statements) {
+        auto bound_request = bindRequest(descriptor, m_program.path(statement), statement.value);
+        if (!bound_request.has_value()) {
+            bound_program.reset();
+            break;
+        }
+        bound_program->push_back(std::move(bound_request.value()));
+    }
+
+    // Unresolvable programs are cached as nullptr as well, so the lookup is not repeated on every call
+    std::unique_lock lock(m_bound_programs_mutex);
+    auto [it, inserted] = m_bound_programs.try_emplace(descriptor, std::move(bound_program));
+    return it->second.get();
+}
+
+void CompiledOverrideProgram::applyRequest(google::protobuf::Message* message, const BoundRequest& request, std::size_t step) {
+    if (step == request.path.size()) {
+        if (request.setter == nullptr || !request.setter(*message, *request.value)) {
+            MessageWrapper::setValue(message, request.field_descriptor, message->GetReflection(), *request.value);
+        }
+        return;
+    }
+
+    const auto& path_step = request.path[step];
+    if (path_step.mutable_message != nullptr) {
+        applyRequest(path_step.mutable_message(*message), request, step + 1);
+        return;
+    }
+
+    auto reflection = message->GetReflection();
+    if (path_step.is_repeated) {
+        int repeated_message_count = reflection->FieldSize(*message, path_step.field_descriptor);
+        for (int i = 0; i < repeated_message_count; i++) {
+            applyRequest(reflection->MutableRepeatedMessage(message, path_step.field_descriptor, i), request, step + 1);
+        }
+    }
+    else {
+        applyRequest(reflection->MutableMessage(message, path_step.field_descriptor), request, step + 1);
+    }
+}
+
+bool CompiledOverrideProgram::apply(google::protobuf::Message& message) const {
+    auto bound_program = bind(message.GetDescriptor());
+    if (bound_program == nullptr) {
+        return false;
+    }
+
+    for (const auto& bound_request : *bound_program) {
+        applyRequest(&message, bound_request, 0);
+    }
+    return true;
+}
+
+auto CompiledOverrideProgram::wirePatch(const google::protobuf::Descriptor* descriptor) const -> const std::string* {
+    {
+        std::shared_lock lock(m_bound_programs_mutex);
+        auto it = m_wire_patches.find(descriptor);
+        if (it != m_wire_patches.end()) {
+            return it->second.has_value() ? &it->second.value() : nullptr;
+        }
+    }
+
+    auto bound_program = bind(descriptor);
+    auto wire_patch = bound_program != nullptr ? grpc_mock_server::encodeWirePatch(*bound_program) : std::nullopt;
+
+    std::unique_lock lock(m_bound_programs_mutex);
+    auto [it, inserted] = m_wire_patches.try_emplace(descriptor, std::move(wire_patch));
+    return it->second.has_value() ? &it->second.value() : nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+OverrideProgramCache::OverrideProgramCache(const RequestLanguage& language, grpc_mock_server::CacheInvalidation invalidation)
+    : m_language(language), m_invalidation(invalidation) {
+}
+
+OverrideProgramCache& OverrideProgramCache::instance() {
+    static OverrideProgramCache instance(RequestLanguage::instance());
+    return instance;
+}
+
+std::shared_ptr<const CompiledOverrideProgram> OverrideProgramCache::get(const std::string& method_name, const std::string& path) {
+    // The file is not touched on a hit unless the modification time is checked
+    std::filesystem::file_time_type write_time;
+    if (m_invalidation == grpc_mock_server::CacheInvalidation::write_time) {
+        std::error_code error;
+        write_time = std::filesystem::last_write_time(path, error);
+        if (error) {
+            return nullptr;
+        }
+    }
+
+    std::uint64_t generation = 0;
+    {
+        std::shared_lock lock(m_mutex);
+        auto it = m_entries.find(method_name);
+        if (it != m_entries.end() && it->second.m_path == path && it->second.m_write_time == write_time) {
+            return it->second.m_program;
+        }
+        generation = m_generation;
+    }
+
+    // Compile outside of the lock: concurrent misses may compile the same file twice, but readers are never blocked by parsing
+    std::string program_data;
+    try {
+        program_data = grpc_mock_server::readFile(path);
+    }
+    catch (const std::ios_base::failure&) {
+        return nullptr;
+    }
+
+    auto program = MessageWrapper::compile(m_language, program_data);
+    if (!program) {
+        return nullptr;
+    }
+
+    std::unique_lock lock(m_mutex);
+    if (m_generation == generation) {
+        m_entries[method_name] = Entry(path, write_time, program);
+    }
+    return program;
+}
+
+void OverrideProgramCache::clear() {
+    std::unique_lock lock(m_mutex);
+    m_entries.clear();
+    m_generation++;
+}
+
+std::size_t OverrideProgramCache::size() const {
+    std::shared_lock lock(m_mutex);
+    return m_entries.size();
+}
@@ -0,0 +1,134 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef GRPC_MOCK_SERVER_OVERRIDE_PROGRAM_H
+#define GRPC_MOCK_SERVER_OVERRIDE_PROGRAM_H
+
+#include "grpc_mock_server_export.h"
+#include "grpc_mock_server_fs_utils.h"
+#include "grpc_mock_server_message_wrapper.h"
+#include "grpc_mock_server_request_language.h"
+#include "grpc_mock_server_typed_fields.h"
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Parsed partial override program: produced once by MessageWrapper::compile() from the program text,
+// after that it can be applied to any number of messages without any PEG work
+class GRPC_MOCK_SERVER_LIBRARY_API CompiledOverrideProgram {
+public:
+    // Request path resolved against the concrete message type;
+    // accessors registered in TypedFieldRegistry are used instead of Reflection where available
+    struct BoundPathStep {
+        const google::protobuf::FieldDescriptor* field_descriptor;
+        bool is_repeated;
+        TypedField::MutableMessage mutable_message = nullptr;
+    };
+
+    struct BoundRequest {
+        std::vector<BoundPathStep> path;
+        const google::protobuf::FieldDescriptor* field_descriptor;
+        const MessageWrapper::ValueView* value;
+        TypedField::Setter setter = nullptr;
+    };
+
+    using BoundProgram = std::vector<BoundRequest>;
+
+private:
+    RequestProgram m_program;
+
+    mutable std::shared_mutex m_bound_programs_mutex;
+    mutable std::unordered_map<const google::protobuf::Descriptor*, std::unique_ptr<const BoundProgram>> m_bound_programs;
+    mutable std::unordered_map<const google::protobuf::Descriptor*, std::optional<std::string>> m_wire_patches;
+
+public:
+    explicit CompiledOverrideProgram(RequestProgram program);
+
+    const RequestProgram& program() const;
+    bool empty() const;
+
+    // Field names are looked up once per message type, the result is cached for the program lifetime;
+    // nullptr if some request path does not match the message type
+    auto bind(const google::protobuf::Descriptor* descriptor) const -> const BoundProgram*;
+    bool apply(google::protobuf::Message& message) const;
+
+    // Serialized fields to be appended to the wire bytes of the message instead of apply(), see grpc_mock_server::encodeWirePatch();
+    // cached per message type as well, nullptr if the program cannot be expressed as a patch
+    auto wirePatch(const google::protobuf::Descriptor* descriptor) const -> const std::string*;
+
+private:
+    static auto bindRequest(
+        const google::protobuf::Descriptor* descriptor,
+        std::span<const std::string_view> path_tokens,
+        const MessageWrapper::ValueView& value
+    ) -> std::optional<BoundRequest>;
+    static void applyRequest(google::protobuf::Message* message, const BoundRequest& request, std::size_t step);
+
+    CompiledOverrideProgram(const CompiledOverrideProgram& root) = delete;
+    CompiledOverrideProgram& operator=(const CompiledOverrideProgram&) = delete;
+};
+
+// Compiled partial override programs, one per method key.
+// Entry is recompiled when the method is bound to another file, after clear(),
+// or when the file modification time changes if the cache checks it (CacheInvalidation::write_time)
+class GRPC_MOCK_SERVER_LIBRARY_API OverrideProgramCache {
+    struct Entry {
+        std::string m_path;
+        std::filesystem::file_time_type m_write_time;
+        std::shared_ptr<const CompiledOverrideProgram> m_program;
+    };
+    using MethodName = std::string;
+    using Entries = std::unordered_map<MethodName, Entry>;
+
+    const RequestLanguage& m_language;
+    grpc_mock_server::CacheInvalidation m_invalidation;
+    mutable std::shared_mutex m_mutex;
+    Entries m_entries;
+    // Incremented by clear(): a file read before the clear() is not cached after it
+    std::uint64_t m_generation = 0;
+
+public:
+    explicit OverrideProgramCache(
+        const RequestLanguage& language,
+        grpc_mock_server::CacheInvalidation invalidation = grpc_mock_server::CacheInvalidation::clear
+    );
+
+    // Process-wide cache using RequestLanguage::instance(), cleared by ConfigWatcher when a mock file changes
+    static OverrideProgramCache& instance();
+
+    // Returns nullptr if the file cannot be read or contains invalid program
+    std::shared_ptr<const CompiledOverrideProgram> get(const std::string& method_name, const std::string& path);
+    void clear();
+    std::size_t size() const;
+
+private:
+    OverrideProgramCache(const OverrideProgramCache& root) = delete;
+    OverrideProgramCache& operator=(const OverrideProgramCache&) = delete;
+};
+
+#endif // GRPC_MOCK_SERVER_OVERRIDE_PROGRAM_H
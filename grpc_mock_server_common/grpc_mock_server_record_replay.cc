@@ -0,0 +1,348 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "grpc_mock_server_record_replay.h"
+#include "grpc_mock_server_utils.h"
+
+#include <google/protobuf/util/json_util.h>
+
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+constexpr std::string_view kNoDatasetDirectory = "_";
+
+bool isPathComponent(std::string_view name) {
+    return !name.empty() && name != "." && name != ".." && name.find_first_of("/\\") == std::string_view::npos;
+}
+
+// Reads the request, forwards it to the remote host and records the response; deletes itself when the call is done
+class ForwardReactor : public grpc::ServerGenericBidiReactor {
+    grpc::GenericCallbackServerContext* m_context;
+    grpc::GenericStub& m_stub;
+    RecordStore& m_store;
+    const google::protobuf::Message& m_prototype;
+    std::string m_dataset_name;
+    // The response is recorded by this call
+    bool m_record;
+
+    grpc::ByteBuffer m_request;
+    grpc::ByteBuffer m_response;
+    std::unique_ptr<grpc::ClientContext> m_client_context;
+
+public:
+    ForwardReactor(
+        grpc::GenericCallbackServerContext* context,
+        grpc::GenericStub& stub,
+        RecordStore& store,
+        const google::protobuf::Message& prototype,
+        std::string_view dataset_name,
+        bool record
+    )
+        : m_context(context), m_stub(stub), m_store(store), m_prototype(prototype), m_dataset_name(dataset_name), m_record(record) {
+        StartRead(&m_request);
+    }
+
+    void OnReadDone(bool ok) override {
+        if (!ok) {
+            cancelRecording();
+            Finish(grpc::Status(grpc::INVALID_ARGUMENT, "no request message"));
+            return;
+        }
+
+        // Deadline and cancellation of the incoming call are propagated to the remote one
+        m_client_context = grpc::ClientContext::FromCallbackServerContext(*m_context);
+        m_stub.UnaryCall(
+            m_client_context.get(),
+            m_context->method(),
+            grpc::StubOptions(),
+            &m_request,
+            &m_response,
+            [this](grpc::Status status) { onResponse(status); }
+        );
+    }
+
+    void OnDone() override {
+        delete this;
+    }
+
+private:
+    void onResponse(const grpc::Status& status) {
+        if (!status.ok()) {
+            cancelRecording();
+            Finish(status);
+            return;
+        }
+        if (!m_record) {
+            StartWriteAndFinish(&m_response, grpc::WriteOptions(), grpc::Status::OK);
+            return;
+        }
+
+        // Answered once the recording is written, so the next call of the client is replayed
+        m_store.saveAsync(m_dataset_name, m_context->method(), m_prototype, m_response, [this](auto recording) {
+            if (!recording) {
+                std::cout << "ERROR: unable to record the response of " << m_context->method() << std::endl;
+            }
+            StartWriteAndFinish(&m_response, grpc::WriteOptions(), grpc::Status::OK);
+        });
+    }
+
+    void cancelRecording() {
+        if (m_record) {
+            m_store.cancelRecording(m_dataset_name, m_context->method());
+            m_record = false;
+        }
+    }
+};
+
+} // anonymous namespace
+
+RecordStore::RecordStore(std::filesystem::path directory)
+    : m_directory(std::move(directory)) {
+    load();
+    m_thread = std::jthread([this](std::stop_token stop_token) { run(stop_token); });
+}
+
+RecordStore::~RecordStore() {
+    m_thread.request_stop();
+    m_thread.join();
+}
+
+void RecordStore::run(std::stop_token stop_token) {
+    std::unique_lock lock(m_queue_mutex);
+    while (true) {
+        // Stop only when the queue is drained
+        m_queue_not_empty.wait(lock, stop_token, [this] { return !m_queue.empty(); });
+        if (m_queue.empty()) {
+            break;
+        }
+
+        auto job = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
+
+auto RecordStore::methodKey(std::string_view dataset_name, std::string_view method_path) -> std::string {
+    if (method_path.starts_with('/')) {
+        method_path.remove_prefix(1);
+    }
+    return std::string(dataset_name) + "." + std::string(method_path);
+}
+
+auto RecordStore::recordingPath(const std::filesystem::path& directory, std::string_view dataset_name, std::string_view method_path)
+    -> std::optional<std::filesystem::path> {
+    if (method_path.starts_with('/')) {
+        method_path.remove_prefix(1);
+    }
+    auto slash_pos = method_path.find('/');
+    if (slash_pos == std::string_view::npos) {
+        return std::nullopt;
+    }
+    auto service_name = method_path.substr(0, slash_pos);
+    auto method_name = method_path.substr(slash_pos + 1);
+    if (dataset_name.empty()) {
+        dataset_name = kNoDatasetDirectory;
+    }
+    if (!isPathComponent(dataset_name) || !isPathComponent(service_name) || !isPathComponent(method_name)) {
+        return std::nullopt;
+    }
+    return directory / dataset_name / service_name / (std::string(method_name) + ".json");
+}
+
+void RecordStore::load() {
+    std::error_code error;
+    if (!std::filesystem::is_directory(m_directory, error)) {
+        return;
+    }
+
+    for (const auto& dataset_entry : std::filesystem::directory_iterator(m_directory, error)) {
+        if (!dataset_entry.is_directory()) {
+            continue;
+        }
+        auto dataset_name = dataset_entry.path().filename().string();
+        if (dataset_name == kNoDatasetDirectory) {
+            dataset_name.clear();
+        }
+
+        for (const auto& service_entry : std::filesystem::directory_iterator(dataset_entry.path(), error)) {
+            if (!service_entry.is_directory()) {
+                continue;
+            }
+            for (const auto& method_entry : std::filesystem::directory_iterator(service_entry.path(), error)) {
+                if (!method_entry.is_regular_file() || method_entry.path().extension() != ".json") {
+                    continue;
+                }
+                auto method_path = service_entry.path().filename().string() + "/" + method_entry.path().stem().string();
+                auto recording = std::make_shared<const Recording>(dataset_name + "." + method_path, method_entry.path().string());
+                add(dataset_name, method_path, std::move(recording));
+            }
+        }
+    }
+}
+
+void RecordStore::add(const std::string& dataset_name, const std::string& method_path, std::shared_ptr<const Recording> recording) {
+    std::unique_lock lock(m_mutex);
+    m_recordings[dataset_name][method_path] = std::move(recording);
+}
+
+auto RecordStore::find(std::string_view dataset_name, std::string_view method_path) const -> std::shared_ptr<const Recording> {
+    if (method_path.starts_with('/')) {
+        method_path.remove_prefix(1);
+    }
+
+    std::shared_lock lock(m_mutex);
+    auto dataset_it = m_recordings.find(dataset_name);
+    if (dataset_it == m_recordings.end()) {
+        return nullptr;
+    }
+    auto method_it = dataset_it->second.find(method_path);
+    return method_it != dataset_it->second.end() ? method_it->second : nullptr;
+}
+
+auto RecordStore::save(
+    std::string_view dataset_name,
+    std::string_view method_path,
+    const google::protobuf::Message& prototype,
+    const grpc::ByteBuffer& response
+) -> std::shared_ptr<const Recording> {
+    auto path = recordingPath(m_directory, dataset_name, method_path);
+    if (!path.has_value()) {
+        return nullptr;
+    }
+
+    std::vector<grpc::Slice> slices;
+    if (!response.Dump(&slices).ok()) {
+        return nullptr;
+    }
+    std::string data;
+    for (const auto& slice : slices) {
+        data.append(reinterpret_cast<const char*>(slice.begin()), slice.size());
+    }
+    std::unique_ptr<google::protobuf::Message> message(prototype.New());
+    std::string json;
+    google::protobuf::util::JsonPrintOptions options;
+    options.add_whitespace = true;
+    if (!message->ParseFromString(data) || !google::protobuf::util::MessageToJsonString(*message, &json, options).ok()) {
+        return nullptr;
+    }
+
+    // Written next to the target under a name of its own and renamed, so a concurrent reader never sees a partial file
+    // and concurrent writers never share the temporary file
+    std::error_code error;
+    std::filesystem::create_directories(path->parent_path(), error);
+    auto temporary_path = *path;
+    temporary_path += "." + std::to_string(m_write_count.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+    {
+        std::ofstream stream(temporary_path, std::ios::binary | std::ios::trunc);
+        stream << json;
+        if (!stream) {
+            return nullptr;
+        }
+    }
+    std::filesystem::rename(temporary_path, *path, error);
+    if (error) {
+        std::filesystem::remove(temporary_path, error);
+        return nullptr;
+    }
+
+    if (method_path.starts_with('/')) {
+        method_path.remove_prefix(1);
+    }
+    auto recording = std::make_shared<const Recording>(std::string(dataset_name) + "." + std::string(method_path), path->string());
+    add(std::string(dataset_name), std::string(method_path), recording);
+    return recording;
+}
+
+bool RecordStore::beginRecording(std::string_view dataset_name, std::string_view method_path) {
+    std::lock_guard lock(m_pending_mutex);
+    return m_pending.insert(methodKey(dataset_name, method_path)).second;
+}
+
+void RecordStore::cancelRecording(std::string_view dataset_name, std::string_view method_path) {
+    std::lock_guard lock(m_pending_mutex);
+    auto it = m_pending.find(methodKey(dataset_name, method_path));
+    if (it != m_pending.end()) {
+        m_pending.erase(it);
+    }
+}
+
+void RecordStore::saveAsync(
+    std::string dataset_name,
+    std::string method_path,
+    const google::protobuf::Message& prototype,
+    grpc::ByteBuffer response,
+    SaveCallback callback
+) {
+    {
+        std::lock_guard lock(m_queue_mutex);
+        m_queue.push_back([=, this, &prototype, callback = std::move(callback)] {
+            auto recording = save(dataset_name, method_path, prototype, response);
+            cancelRecording(dataset_name, method_path);
+            callback(std::move(recording));
+        });
+    }
+    m_queue_not_empty.notify_one();
+}
+
+std::size_t RecordStore::size() const {
+    std::shared_lock lock(m_mutex);
+    std::size_t result = 0;
+    for (const auto& [dataset_name, recordings] : m_recordings) {
+        result += recordings.size();
+    }
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RecordReplayService::RecordReplayService(RecordStore& store, std::shared_ptr<ChannelPool> channel_pool, ResponseCache& cache)
+    : MockGenericService(cache), m_store(store), m_channel_pool(std::move(channel_pool)) {
+}
+
+grpc::ServerGenericBidiReactor* RecordReplayService::CreateReactor(grpc::GenericCallbackServerContext* context) {
+    auto dataset_name = getDatasetNameView(context);
+    if (Config::instance().snapshot()->findMethod(dataset_name, context->method()) != nullptr) {
+        return MockGenericService::CreateReactor(context);
+    }
+
+    auto prototype = responsePrototype(context->method());
+    if (prototype == nullptr) {
+        return finishWith(grpc::Status(grpc::UNIMPLEMENTED, "unknown or streaming method " + context->method()));
+    }
+
+    auto recording = m_store.find(dataset_name, context->method());
+    if (recording) {
+        auto response = cache().getWire(*prototype, recording->m_method_name, recording->m_path);
+        if (response.has_value()) {
+            return respondWith(response.value());
+        }
+    }
+
+    if (!m_channel_pool) {
+        return finishWith(grpc::Status(grpc::UNIMPLEMENTED, "no mock data for " + context->method()));
+    }
+    auto record = m_store.beginRecording(dataset_name, context->method());
+    return new ForwardReactor(context, m_channel_pool->stub(), m_store, *prototype, dataset_name, record);
+}
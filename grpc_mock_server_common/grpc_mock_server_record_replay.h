@@ -0,0 +1,158 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef GRPC_MOCK_SERVER_RECORD_REPLAY_H
+#define GRPC_MOCK_SERVER_RECORD_REPLAY_H
+
+#include "grpc_mock_server_export.h"
+#include "grpc_mock_server_channel_pool.h"
+#include "grpc_mock_server_configuration.h"
+#include "grpc_mock_server_generic_service.h"
+
+#include <google/protobuf/message.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+// Responses captured from the remote host, stored as JSON full responses:
+//
+//     <directory>/<dataset>/<package>.<Service>/<Method>.json
+//
+// Calls without a dataset are stored in the "_" dataset directory. Existing recordings are loaded on construction,
+// so the remote host is called once per method across restarts.
+// saveAsync() writes the files on a thread of the store, so gRPC callbacks never wait for the disk
+class GRPC_MOCK_SERVER_LIBRARY_API RecordStore {
+public:
+    struct Recording {
+        // Method key "dataset.package.Service/Method", same as the config one
+        std::string m_method_name;
+        std::string m_path;
+    };
+    using SaveCallback = std::function<void(std::shared_ptr<const Recording> recording)>;
+
+private:
+    struct StringHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view value) const {
+            return std::hash<std::string_view>()(value);
+        }
+    };
+    template <typename Value>
+    using StringMap = std::unordered_map<std::string, Value, StringHash, std::equal_to<>>;
+
+    std::filesystem::path m_directory;
+    mutable std::shared_mutex m_mutex;
+    // Dataset name -> method path "package.Service/Method" -> recording
+    StringMap<StringMap<std::shared_ptr<const Recording>>> m_recordings;
+    // Method keys of the responses being recorded
+    std::mutex m_pending_mutex;
+    std::set<std::string, std::less<>> m_pending;
+    // Makes the temporary file names unique
+    std::atomic<std::uint64_t> m_write_count = 0;
+
+    std::mutex m_queue_mutex;
+    std::condition_variable_any m_queue_not_empty;
+    std::deque<std::function<void()>> m_queue;
+    std::jthread m_thread;
+
+public:
+    explicit RecordStore(std::filesystem::path directory);
+    // Queued saves are finished before the thread stops
+    ~RecordStore();
+
+    // Method path is the gRPC one, e.g. "/routeguide.RouteGuide/GetFeature"; nullptr if the method is not recorded
+    auto find(std::string_view dataset_name, std::string_view method_path) const -> std::shared_ptr<const Recording>;
+
+    // Writes the response as JSON, replacing the previous recording; nullptr if the response cannot be parsed or written
+    auto save(
+        std::string_view dataset_name,
+        std::string_view method_path,
+        const google::protobuf::Message& prototype,
+        const grpc::ByteBuffer& response
+    ) -> std::shared_ptr<const Recording>;
+
+    // Claims the method for recording; false if another call records it already.
+    // The claim ends with saveAsync() or cancelRecording()
+    bool beginRecording(std::string_view dataset_name, std::string_view method_path);
+    void cancelRecording(std::string_view dataset_name, std::string_view method_path);
+    // save() on the store thread, then ends the claim and passes the recording (nullptr on failure) to the callback
+    void saveAsync(
+        std::string dataset_name,
+        std::string method_path,
+        const google::protobuf::Message& prototype,
+        grpc::ByteBuffer response,
+        SaveCallback callback
+    );
+
+    std::size_t size() const;
+    static auto recordingPath(const std::filesystem::path& directory, std::string_view dataset_name, std::string_view method_path)
+        -> std::optional<std::filesystem::path>;
+
+private:
+    void load();
+    void run(std::stop_token stop_token);
+    static auto methodKey(std::string_view dataset_name, std::string_view method_path) -> std::string;
+    void add(const std::string& dataset_name, const std::string& method_path, std::shared_ptr<const Recording> recording);
+
+    RecordStore(const RecordStore& root) = delete;
+    RecordStore& operator=(const RecordStore&) = delete;
+};
+
+// MockGenericService that forwards the calls it cannot answer to the remote host:
+//
+//     RecordStore store("recordings");
+//     RecordReplayService service(store, ChannelPool::fromConfig(*Config::instance().snapshot()));
+//     builder.RegisterCallbackGenericService(&service);
+//
+// Methods mocked in Config are served as usual, recorded methods are replayed from the store,
+// the rest are forwarded as raw bytes and the response is recorded. Only one call at a time records a method,
+// the calls made meanwhile are forwarded without recording. Upstream errors are passed to the client and not recorded
+class GRPC_MOCK_SERVER_LIBRARY_API RecordReplayService : public MockGenericService {
+    RecordStore& m_store;
+    std::shared_ptr<ChannelPool> m_channel_pool;
+
+public:
+    // Calls are not forwarded without the channel pool
+    RecordReplayService(
+        RecordStore& store,
+        std::shared_ptr<ChannelPool> channel_pool,
+        ResponseCache& cache = ResponseCache::instance()
+    );
+
+    grpc::ServerGenericBidiReactor* CreateReactor(grpc::GenericCallbackServerContext* context) override;
+
+private:
+    RecordReplayService(const RecordReplayService& root) = delete;
+    RecordReplayService& operator=(const RecordReplayService&) = delete;
+};
+
+#endif // GRPC_MOCK_SERVER_RECORD_REPLAY_H
@@ -0,0 +1,541 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "grpc_mock_server_request_language.h"
+
+#include <charconv>
+#include <peglib.h>
+
+// CMakeRC
+#include <cmrc/cmrc.hpp>
+CMRC_DECLARE(grpc_mock_server);
+
+using RequestWithValue = MessageWrapper::RequestWithValue;
+using ValueView = MessageWrapper::ValueView;
+using EnumView = MessageWrapper::EnumView;
+using ArrayView = MessageWrapper::ArrayView;
+
+std::span<const std::string_view> RequestProgram::path(const RequestStatement& statement) const {
+    return std::span<const std::string_view>(path_tokens.data() + statement.path_offset, statement.path_size);
+}
+
+std::vector<RequestWithValue> RequestProgram::toRequests() const {
+    std::vector<RequestWithValue> result;
+    result.reserve(statements.size());
+    for (const auto& statement : statements) {
+        auto statement_path = path(statement);
+        result.emplace_back(
+            std::vector<std::string>(statement_path.begin(), statement_path.end()),
+            MessageWrapper::toValueWrapper(statement.value)
+        );
+    }
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Hand-written parser of assets/request_grammar.txt.
+// Follows the PEG rules one to one (ordered choice without backtracking into a matched alternative),
+// so it accepts exactly the same programs and produces exactly the same AST as the peglib backend
+class NativeRequestParser {
+    std::string_view m_input;
+    std::size_t m_pos = 0;
+    RequestProgram& m_program;
+
+public:
+    NativeRequestParser(std::string_view input, RequestProgram& program)
+        : m_input(input), m_program(program) {
+    }
+
+    // program <- (comment / statement)*
+    bool parseProgram() {
+        while (m_pos < m_input.size()) {
+            bool matched = (m_input[m_pos] == '#') ? parseComment() : parseStatement();
+            if (!matched) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    static bool isIdentFirst(char ch) {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+    }
+
+    static bool isIdentNext(char ch) {
+        return isIdentFirst(ch) || isDigit(ch);
+    }
+
+    static bool isDigit(char ch) {
+        return ch >= '0' && ch <= '9';
+    }
+
+    static bool isHexDigit(char ch) {
+        return isDigit(ch) || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+    }
+
+    static bool isNewLine(char ch) {
+        return ch == '\r' || ch == '\n';
+    }
+
+    char at(std::size_t pos) const {
+        return pos < m_input.size() ? m_input[pos] : '\0';
+    }
+
+    bool startsWith(std::size_t pos, std::string_view literal) const {
+        return m_input.substr(pos, literal.size()) == literal;
+    }
+
+    // ~nl <- [\r\n]+
+    bool parseNewLine(std::size_t& pos) const {
+        if (!isNewLine(at(pos))) {
+            return false;
+        }
+        while (isNewLine(at(pos))) {
+            pos++;
+        }
+        return true;
+    }
+
+    // ~ws <- [ \t]*
+    void skipWhitespace(std::size_t& pos) const {
+        while (at(pos) == ' ' || at(pos) == '\t') {
+            pos++;
+        }
+    }
+
+    // ~comment <- '#' [^\r\n]* nl
+    bool parseComment() {
+        std::size_t pos = m_pos + 1;
+        while (pos < m_input.size() && !isNewLine(m_input[pos])) {
+            pos++;
+        }
+        if (!parseNewLine(pos)) {
+            return false;
+        }
+        m_pos = pos;
+        return true;
+    }
+
+    // ident <- ident_array / ident_item
+    // ident_item <- [a-zA-Z_][a-zA-Z_0-9]*
+    // ident_array <- ident_item '[]'
+    bool parseIdent(std::size_t& pos) const {
+        if (!isIdentFirst(at(pos))) {
+            return false;
+        }
+        pos++;
+        while (isIdentNext(at(pos))) {
+            pos++;
+        }
+        if (startsWith(pos, "[]")) {
+            pos += 2;
+        }
+        return true;
+    }
+
+    // request <- (ident '.')* ident
+    bool parseRequest(std::size_t& pos) const {
+        if (!parseIdent(pos)) {
+            return false;
+        }
+        while (at(pos) == '.') {
+            pos++;
+            if (!parseIdent(pos)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // int <- '0' / ('-'? [1-9][0-9]*)
+    bool parseInt(std::size_t& pos) const {
+        if (at(pos) == '0') {
+            pos++;
+            return true;
+        }
+        std::size_t int_pos = pos;
+        if (at(int_pos) == '-') {
+            int_pos++;
+        }
+        if (at(int_pos) < '1' || at(int_pos) > '9') {
+            return false;
+        }
+        while (isDigit(at(int_pos))) {
+            int_pos++;
+        }
+        pos = int_pos;
+        return true;
+    }
+
+    // number <- float / int
+    // float <- < int frac >
+    // frac <- ('.' [0-9]+)+
+    bool parseNumber(std::size_t& pos, ValueView& value) const {
+        std::size_t number_pos = pos;
+        if (!parseInt(number_pos)) {
+            return false;
+        }
+
+        bool is_float = false;
+        while (at(number_pos) == '.' && isDigit(at(number_pos + 1))) {
+            number_pos += 2;
+            while (isDigit(at(number_pos))) {
+                number_pos++;
+            }
+            is_float = true;
+        }
+
+        const char* first = m_input.data() + pos;
+        const char* last = m_input.data() + number_pos;
+        if (is_float) {
+            double double_value = 0;
+            std::from_chars(first, last, double_value);
+            value = double_value;
+        }
+        else {
+            int64_t int_value = 0;
+            std::from_chars(first, last, int_value);
+            value = int_value;
+        }
+        pos = number_pos;
+        return true;
+    }
+
+    // Length of the UTF-8 encoded code point, 0 if the lead byte is invalid or the sequence is truncated
+    std::size_t codePointLength(std::size_t pos) const {
+        auto lead = static_cast<unsigned char>(m_input[pos]);
+        std::size_t length = 0;
+        if (lead < 0x80) {
+            length = 1;
+        }
+        else if ((lead & 0xE0) == 0xC0) {
+            length = 2;
+        }
+        else if ((lead & 0xF0) == 0xE0) {
+            length = 3;
+        }
+        else if ((lead & 0xF8) == 0xF0) {
+            length = 4;
+        }
+        return (pos + length <= m_input.size()) ? length : 0;
+    }
+
+    // string <- '"' < char* > '"'
+    // char <- unescaped / escaped
+    // escaped <- '\\' (["\\/bfnrt] / 'u' [a-fA-F0-9]{4})
+    // unescaped <- [\u0020-\u0021\u0023-\u005b\u005d-\u10ffff]
+    bool parseString(std::size_t& pos, std::string_view& token) const {
+        if (at(pos) != '"') {
+            return false;
+        }
+        std::size_t token_begin = pos + 1;
+        std::size_t string_pos = token_begin;
+        while (string_pos < m_input.size()) {
+            char ch = m_input[string_pos];
+            if (ch == '\\') {
+                char escaped = at(string_pos + 1);
+                if (escaped == '"' || escaped == '\\' || escaped == '/' || escaped == 'b'
+                    || escaped == 'f' || escaped == 'n' || escaped == 'r' || escaped == 't') {
+                    string_pos += 2;
+                    continue;
+                }
+                if (escaped == 'u' && isHexDigit(at(string_pos + 2)) && isHexDigit(at(string_pos + 3))
+                    && isHexDigit(at(string_pos + 4)) && isHexDigit(at(string_pos + 5))) {
+                    string_pos += 6;
+                    continue;
+                }
+                break;
+            }
+            if (ch == '"' || static_cast<unsigned char>(ch) < 0x20) {
+                break;
+            }
+            std::size_t length = codePointLength(string_pos);
+            if (length == 0) {
+                break;
+            }
+            string_pos += length;
+        }
+        if (at(string_pos) != '"') {
+            return false;
+        }
+        token = m_input.substr(token_begin, string_pos - token_begin);
+        pos = string_pos + 1;
+        return true;
+    }
+
+    // value_item <- null / boolean / number / string / enum
+    bool parseValueItem(std::size_t& pos, ValueView& value) const {
+        if (startsWith(pos, "null")) {
+            value = nullptr;
+            pos += 4;
+            return true;
+        }
+        if (startsWith(pos, "false")) {
+            value = false;
+            pos += 5;
+            return true;
+        }
+        if (startsWith(pos, "true")) {
+            value = true;
+            pos += 4;
+            return true;
+        }
+        if (parseNumber(pos, value)) {
+            return true;
+        }
+
+        std::string_view token;
+        if (parseString(pos, token)) {
+            value = token;
+            return true;
+        }
+
+        std::size_t enum_pos = pos;
+        if (parseIdent(enum_pos)) {
+            value = EnumView(m_input.substr(pos, enum_pos - pos));
+            pos = enum_pos;
+            return true;
+        }
+        return false;
+    }
+
+    // value <- value_item / value_array
+    // value_array <- '[' value_item (',' value_item)* ']'
+    bool parseValue(std::size_t& pos, ValueView& value) const {
+        if (parseValueItem(pos, value)) {
+            return true;
+        }
+        if (at(pos) != '[') {
+            return false;
+        }
+
+        auto& array_items = *m_program.array_items;
+        std::size_t array_offset = array_items.size();
+        auto rollback = [&array_items, array_offset] {
+            array_items.resize(array_offset);
+            return false;
+        };
+
+        std::size_t array_pos = pos + 1;
+        ValueView item;
+        if (!parseValueItem(array_pos, item)) {
+            return rollback();
+        }
+        array_items.push_back(item);
+        while (at(array_pos) == ',') {
+            array_pos++;
+            if (!parseValueItem(array_pos, item)) {
+                return rollback();
+            }
+            array_items.push_back(item);
+        }
+        if (at(array_pos) != ']') {
+            return rollback();
+        }
+
+        value = ArrayView(std::span<const ValueView>(array_items.data() + array_offset, array_items.size() - array_offset));
+        pos = array_pos + 1;
+        return true;
+    }
+
+    // statement <- request ws ':=' ws value nl
+    bool parseStatement() {
+        std::size_t pos = m_pos;
+        if (!parseRequest(pos)) {
+            return false;
+        }
+        std::string_view request = m_input.substr(m_pos, pos - m_pos);
+
+        skipWhitespace(pos);
+        if (!startsWith(pos, ":=")) {
+            return false;
+        }
+        pos += 2;
+        skipWhitespace(pos);
+
+        RequestStatement statement;
+        if (!parseValue(pos, statement.value) || !parseNewLine(pos)) {
+            return false;
+        }
+
+        statement.path_offset = m_program.path_tokens.size();
+        while (true) {
+            auto dot_pos = request.find('.');
+            m_program.path_tokens.emplace_back(request.substr(0, dot_pos));
+            if (dot_pos == std::string_view::npos) {
+                break;
+            }
+            request.remove_prefix(dot_pos + 1);
+        }
+        statement.path_size = m_program.path_tokens.size() - statement.path_offset;
+        m_program.statements.push_back(std::move(statement));
+
+        m_pos = pos;
+        return true;
+    }
+};
+
+} // anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RequestLanguage::RequestLanguage(const std::string& grammar, Backend backend)
+    : m_parser(std::make_unique<peg::parser>(grammar)), m_backend(backend) {
+    assert(static_cast<bool>(*m_parser) == true);
+
+    auto& parser = *m_parser;
+
+    // Every value rule yields a ValueView, and the statement appends itself to the RequestProgram passed as user data,
+    // so there is no type dispatch over std::any and no intermediate per-statement containers
+    parser["statement"] = [](peg::SemanticValues& vs, std::any& dt) {
+        auto& program = *std::any_cast<RequestProgram*>(dt);
+
+        RequestStatement statement;
+        statement.path_offset = program.path_tokens.size();
+
+        auto request = std::any_cast<std::string_view>(vs[0]);
+        while (true) {
+            auto dot_pos = request.find('.');
+            program.path_tokens.emplace_back(request.substr(0, dot_pos));
+            if (dot_pos == std::string_view::npos) {
+                break;
+            }
+            request.remove_prefix(dot_pos + 1);
+        }
+        statement.path_size = program.path_tokens.size() - statement.path_offset;
+
+        statement.value = std::any_cast<ValueView>(vs[1]);
+        program.statements.push_back(std::move(statement));
+    };
+
+    parser["request"] = [](const peg::SemanticValues& vs) {
+        return vs.sv();
+    };
+
+    parser["value_array"] = [](peg::SemanticValues& vs, std::any& dt) {
+        auto& array_items = *std::any_cast<RequestProgram*>(dt)->array_items;
+        // Capacity is reserved up front, growing the vector would invalidate the spans of the previous arrays
+        assert(array_items.size() + vs.size() <= array_items.capacity());
+
+        std::size_t array_offset = array_items.size();
+        for (const auto& item : vs) {
+            array_items.push_back(std::any_cast<ValueView>(item));
+        }
+        return ValueView(ArrayView(std::span<const ValueView>(array_items.data() + array_offset, vs.size())));
+    };
+
+    parser["null"] = [](const peg::SemanticValues& vs) {
+        return ValueView(nullptr);
+    };
+
+    parser["boolean"] = [](const peg::SemanticValues& vs) {
+        // 'false' / 'true'
+        return ValueView(vs.choice() == 1);
+    };
+
+    parser["float"] = [](const peg::SemanticValues& vs) {
+        return ValueView(vs.token_to_number<double>());
+    };
+
+    parser["int"] = [](const peg::SemanticValues& vs) {
+        return ValueView(vs.token_to_number<int64_t>());
+    };
+
+    parser["string"] = [](const peg::SemanticValues& vs) {
+        return ValueView(vs.token());
+    };
+
+    parser["enum"] = [](const peg::SemanticValues& vs) {
+        return ValueView(EnumView(vs.token()));
+    };
+
+    parser.enable_packrat_parsing();
+}
+
+RequestLanguage::~RequestLanguage() {
+}
+
+const RequestLanguage& RequestLanguage::instance() {
+    static const RequestLanguage instance([] {
+        auto rc_fs = cmrc::grpc_mock_server::get_filesystem();
+        auto grammar_file = rc_fs.open("assets/request_grammar.txt");
+        return std::string(grammar_file.cbegin(), grammar_file.cend());
+    }());
+    return instance;
+}
+
+bool RequestLanguage::isValid() const {
+    return static_cast<bool>(*m_parser);
+}
+
+auto RequestLanguage::backend() const -> Backend {
+    return m_backend;
+}
+
+auto RequestLanguage::parseProgram(std::string program) const -> std::optional<RequestProgram> {
+    return parseProgram(std::move(program), m_backend);
+}
+
+auto RequestLanguage::parseProgram(std::string program, Backend backend) const -> std::optional<RequestProgram> {
+    RequestProgram result;
+    result.source = std::make_shared<const std::string>(std::move(program));
+    const std::string& source = *result.source;
+
+    // Every statement ends with a new line, every path token but the first one follows a dot
+    // and every array item follows either '[' or ',', so a single scan gives the upper bounds
+    // and all vectors are allocated exactly once
+    std::size_t new_line_count = 0;
+    std::size_t dot_count = 0;
+    std::size_t array_item_count = 0;
+    for (char ch : source) {
+        new_line_count += (ch == '\n' || ch == '\r');
+        dot_count += (ch == '.');
+        array_item_count += (ch == '[' || ch == ',');
+    }
+    result.statements.reserve(new_line_count);
+    result.path_tokens.reserve(new_line_count + dot_count);
+    result.array_items = std::make_shared<std::vector<ValueView>>();
+    result.array_items->reserve(array_item_count);
+
+    bool parse_result = false;
+    switch (backend) {
+    case Backend::Peg: {
+        std::any dt = &result;
+        parse_result = m_parser->parse(source, dt);
+        break;
+    }
+    case Backend::Native: {
+        parse_result = NativeRequestParser(source, result).parseProgram();
+        break;
+    }
+    }
+    return parse_result ? std::optional<RequestProgram>(std::move(result)) : std::nullopt;
+}
+
+auto RequestLanguage::parse(const std::string& program) const -> std::optional<std::vector<RequestWithValue>> {
+    return parse(program, m_backend);
+}
+
+auto RequestLanguage::parse(const std::string& program, Backend backend) const -> std::optional<std::vector<RequestWithValue>> {
+    auto result = parseProgram(program, backend);
+    return result.has_value() ? std::optional<std::vector<RequestWithValue>>(result->toRequests()) : std::nullopt;
+}
@@ -0,0 +1,95 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef GRPC_MOCK_SERVER_REQUEST_LANGUAGE_H
+#define GRPC_MOCK_SERVER_REQUEST_LANGUAGE_H
+
+#include "grpc_mock_server_export.h"
+#include "grpc_mock_server_message_wrapper.h"
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <string>
+#include <vector>
+
+namespace peg {
+class parser;
+}
+
+// Typed AST of the mock data request language
+struct GRPC_MOCK_SERVER_LIBRARY_API RequestStatement {
+    // Span of RequestProgram::path_tokens
+    std::size_t path_offset = 0;
+    std::size_t path_size = 0;
+    MessageWrapper::ValueView value;
+};
+
+// Path tokens and string values are views into the program text, which is owned by the program itself;
+// building the AST takes a constant number of allocations regardless of the statement count
+struct GRPC_MOCK_SERVER_LIBRARY_API RequestProgram {
+    std::shared_ptr<const std::string> source;
+    // Path tokens of all statements, e.g. "features[]", "location", "latitude"
+    std::vector<std::string_view> path_tokens;
+    std::vector<RequestStatement> statements;
+    // Items of all array values; reserved once before parsing, so ArrayView spans stay valid.
+    // Shared, as the spans point into the vector and must survive program copies
+    std::shared_ptr<std::vector<MessageWrapper::ValueView>> array_items;
+
+    std::span<const std::string_view> path(const RequestStatement& statement) const;
+    std::vector<MessageWrapper::RequestWithValue> toRequests() const;
+};
+
+// Mock data request language engine.
+// Grammar is compiled and semantic actions are registered once in the constructor;
+// parse() is const and may be called concurrently from any number of threads
+class GRPC_MOCK_SERVER_LIBRARY_API RequestLanguage {
+public:
+    enum class Backend {
+        // cpp-peglib parser generated from the grammar text, reference implementation
+        Peg,
+        // Hand-written single pass parser of assets/request_grammar.txt, does not allocate while scanning
+        Native
+    };
+
+private:
+    std::unique_ptr<peg::parser> m_parser;
+    Backend m_backend;
+
+public:
+    explicit RequestLanguage(const std::string& grammar, Backend backend = Backend::Native);
+    ~RequestLanguage();
+
+    // Process-wide instance built from the grammar embedded into the library resources
+    static const RequestLanguage& instance();
+
+    bool isValid() const;
+    auto backend() const -> Backend;
+
+    auto parseProgram(std::string program) const -> std::optional<RequestProgram>;
+    auto parseProgram(std::string program, Backend backend) const -> std::optional<RequestProgram>;
+    auto parse(const std::string& program) const -> std::optional<std::vector<MessageWrapper::RequestWithValue>>;
+    auto parse(const std::string& program, Backend backend) const -> std::optional<std::vector<MessageWrapper::RequestWithValue>>;
+
+private:
+    RequestLanguage(const RequestLanguage& root) = delete;
+    RequestLanguage& operator=(const RequestLanguage&) = delete;
+};
+
+#endif // GRPC_MOCK_SERVER_REQUEST_LANGUAGE_H
@@ -0,0 +1,381 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "grpc_mock_server_response.h"
+#include "grpc_mock_server_binary_mock.h"
+#include "grpc_mock_server_configuration.h"
+#include "grpc_mock_server_fs_utils.h"
+#include "grpc_mock_server_override_program.h"
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/util/json_util.h>
+
+#include <iostream>
+#include <mutex>
+
+namespace grpc_mock_server {
+
+void MessageDeleter::operator()(google::protobuf::Message* message) const {
+    if (message != nullptr && message->GetArena() == nullptr) {
+        delete message;
+    }
+}
+
+auto newMessage(const google::protobuf::Message& prototype, google::protobuf::Arena* arena) -> MessagePtr {
+    return MessagePtr(prototype.New(arena));
+}
+
+auto loadResponse(
+    const google::protobuf::Message& prototype,
+    const std::string& full_path,
+    google::protobuf::Arena* arena,
+    std::optional<std::string>* binary_wire
+) -> MessagePtr {
+    // The mapping is dropped when the message is built, nothing refers to the file data afterwards
+    std::optional<MappedFile> response_file;
+    std::string response_copy;
+    std::string_view response_data;
+    std::error_code error;
+    auto file_size = std::filesystem::file_size(full_path, error);
+    if (!error && file_size >= kMappedResponseMinSize) {
+        response_file = MappedFile::open(full_path, MappedFile::Access::sequential);
+        if (!response_file.has_value()) {
+            std::cout << "ERROR: unable to read response file " << full_path << std::endl;
+            return nullptr;
+        }
+        response_data = response_file->view();
+    }
+    else {
+        // Copying a small file costs less than mapping it
+        try {
+            response_copy = readBinaryFile(full_path);
+        }
+        catch (const std::ios_base::failure&) {
+            std::cout << "ERROR: unable to read response file " << full_path << std::endl;
+            return nullptr;
+        }
+        response_data = response_copy;
+    }
+
+    auto result = newMessage(prototype, arena);
+    if (isBinaryMock(response_data)) {
+        auto binary_mock = readBinaryMock(response_data);
+        if (!binary_mock.has_value() || binary_mock->m_messages.size() != 1) {
+            std::cout << "ERROR: invalid binary response file " << full_path << std::endl;
+            return nullptr;
+        }
+        if (binary_mock->m_type_name != prototype.GetDescriptor()->full_name()) {
+            std::cout << "ERROR: response file " << full_path << " holds " << binary_mock->m_type_name
+                << " instead of " << prototype.GetDescriptor()->full_name() << std::endl;
+            return nullptr;
+        }
+
+        auto wire = binary_mock->m_messages.front();
+        google::protobuf::io::ArrayInputStream wire_stream(wire.data(), static_cast<int>(wire.size()));
+        if (!result->ParseFromZeroCopyStream(&wire_stream)) {
+            std::cout << "ERROR: invalid binary response file " << full_path << std::endl;
+            return nullptr;
+        }
+        if (binary_wire != nullptr) {
+            *binary_wire = std::string(wire);
+        }
+        return result;
+    }
+
+    auto status = google::protobuf::util::JsonStringToMessage(
+        google::protobuf::StringPiece(response_data.data(), response_data.size()),
+        result.get()
+    );
+    if (!status.ok()) {
+        std::cout << "ERROR: invalid response file " << full_path << ": " << status.message() << std::endl;
+        return nullptr;
+    }
+    return result;
+}
+
+auto buildResponse(
+    const google::protobuf::Message& prototype,
+    const std::string& method_name,
+    const std::string& full_path,
+    const std::string& partial_path,
+    google::protobuf::Arena* arena
+) -> MessagePtr {
+    auto result = full_path.empty() ? newMessage(prototype, arena) : loadResponse(prototype, full_path, arena);
+    if (!result || partial_path.empty()) {
+        return result;
+    }
+
+    auto program = OverrideProgramCache::instance().get(method_name, partial_path);
+    if (!program || !program->apply(*result)) {
+        std::cout << "ERROR: unable to apply partial override " << partial_path << " to " << method_name << std::endl;
+        return nullptr;
+    }
+    return result;
+}
+
+namespace {
+
+constexpr std::size_t kArenaInitialBlockSize = 64 * 1024;
+
+auto arenaOptions(char* initial_block) -> google::protobuf::ArenaOptions {
+    google::protobuf::ArenaOptions options;
+    options.initial_block = initial_block;
+    options.initial_block_size = kArenaInitialBlockSize;
+    return options;
+}
+
+// Arena private to ResponseCache::buildWire(), which resets it after every call:
+// resetting threadArena() there would free the messages its callers keep on it
+auto wireArena() -> google::protobuf::Arena& {
+    thread_local std::unique_ptr<char[]> initial_block(new char[kArenaInitialBlockSize]);
+    thread_local google::protobuf::Arena arena(arenaOptions(initial_block.get()));
+    return arena;
+}
+
+} // anonymous namespace
+
+auto threadArena() -> google::protobuf::Arena& {
+    // Declared before the arena, so it is destroyed after it
+    thread_local std::unique_ptr<char[]> initial_block(new char[kArenaInitialBlockSize]);
+    thread_local google::protobuf::Arena arena(arenaOptions(initial_block.get()));
+    return arena;
+}
+
+} // grpc_mock_server
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+MockResponse::MockResponse(std::shared_ptr<const google::protobuf::Message> shared)
+    : m_shared(std::move(shared)) {
+}
+
+MockResponse::MockResponse(grpc_mock_server::MessagePtr modified)
+    : m_modified(std::move(modified)) {
+}
+
+MockResponse::operator bool() const {
+    return m_shared || m_modified;
+}
+
+bool MockResponse::isShared() const {
+    return static_cast<bool>(m_shared);
+}
+
+const google::protobuf::Message& MockResponse::message() const {
+    assert(static_cast<bool>(*this));
+    return m_modified ? *m_modified : *m_shared;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ResponseCache::ResponseCache(grpc_mock_server::CacheInvalidation invalidation)
+    : m_invalidation(invalidation) {
+}
+
+ResponseCache& ResponseCache::instance() {
+    static ResponseCache instance;
+    return instance;
+}
+
+auto ResponseCache::lookup(const google::protobuf::Message& prototype, const std::string& method_name, const std::string& full_path)
+    -> std::shared_ptr<const CachedResponse> {
+    // The file is not touched on a hit unless the modification time is checked
+    std::filesystem::file_time_type write_time;
+    if (m_invalidation == grpc_mock_server::CacheInvalidation::write_time) {
+        std::error_code error;
+        write_time = std::filesystem::last_write_time(full_path, error);
+        if (error) {
+            return nullptr;
+        }
+    }
+
+    std::uint64_t generation = 0;
+    {
+        std::shared_lock lock(m_mutex);
+        auto it = m_entries.find(method_name);
+        if (it != m_entries.end() && it->second.m_path == full_path && it->second.m_write_time == write_time) {
+            return it->second.m_response;
+        }
+        generation = m_generation;
+    }
+
+    // Parse outside of the lock, as OverrideProgramCache does
+    std::optional<std::string> binary_wire;
+    std::shared_ptr<const google::protobuf::Message> message = grpc_mock_server::loadResponse(prototype, full_path, nullptr, &binary_wire);
+    if (!message) {
+        return nullptr;
+    }
+
+    // Binary files already hold the wire bytes
+    std::string wire_data;
+    if (binary_wire.has_value()) {
+        wire_data = std::move(binary_wire.value());
+    }
+    else if (!message->SerializeToString(&wire_data)) {
+        std::cout << "ERROR: unable to serialize response " << full_path << std::endl;
+        return nullptr;
+    }
+    grpc::Slice wire_slice(wire_data);
+    auto response = std::make_shared<const CachedResponse>(std::move(message), wire_slice, grpc::ByteBuffer(&wire_slice, 1));
+
+    std::unique_lock lock(m_mutex);
+    if (m_generation == generation) {
+        m_entries[method_name] = Entry(full_path, write_time, response);
+    }
+    return response;
+}
+
+auto ResponseCache::get(const google::protobuf::Message& prototype, const std::string& method_name, const std::string& full_path)
+    -> std::shared_ptr<const google::protobuf::Message> {
+    auto response = lookup(prototype, method_name, full_path);
+    return response ? response->m_message : nullptr;
+}
+
+auto ResponseCache::getWire(const google::protobuf::Message& prototype, const std::string& method_name, const std::string& full_path)
+    -> std::optional<grpc::ByteBuffer> {
+    auto response = lookup(prototype, method_name, full_path);
+    return response ? std::optional<grpc::ByteBuffer>(response->m_wire) : std::nullopt;
+}
+
+auto ResponseCache::buildWire(
+    const google::protobuf::Message& prototype,
+    const std::string& method_name,
+    const std::string& full_path,
+    const std::string& partial_path,
+    MethodMetrics* metrics
+) -> std::optional<grpc::ByteBuffer> {
+    if (partial_path.empty()) {
+        if (full_path.empty()) {
+            // Empty message
+            grpc::Slice empty_slice;
+            return grpc::ByteBuffer(&empty_slice, 1);
+        }
+        StageTimer load_timer(metrics, MethodMetrics::Stage::load);
+        return getWire(prototype, method_name, full_path);
+    }
+
+    std::shared_ptr<const CompiledOverrideProgram> program;
+    const std::string* wire_patch = nullptr;
+    {
+        StageTimer override_timer(metrics, MethodMetrics::Stage::override_apply);
+        program = OverrideProgramCache::instance().get(method_name, partial_path);
+        if (!program) {
+            std::cout << "ERROR: unable to compile partial override " << partial_path << std::endl;
+            return std::nullopt;
+        }
+        wire_patch = program->wirePatch(prototype.GetDescriptor());
+    }
+
+    if (wire_patch != nullptr) {
+        grpc::Slice patch_slice(*wire_patch);
+        if (full_path.empty()) {
+            return grpc::ByteBuffer(&patch_slice, 1);
+        }
+
+        StageTimer load_timer(metrics, MethodMetrics::Stage::load);
+        auto response = lookup(prototype, method_name, full_path);
+        if (!response) {
+            return std::nullopt;
+        }
+        grpc::Slice slices[] = { response->m_wire_slice, patch_slice };
+        return grpc::ByteBuffer(slices, std::size(slices));
+    }
+
+    auto& arena = grpc_mock_server::wireArena();
+    auto response = build(prototype, method_name, full_path, partial_path, &arena, metrics);
+    if (!response) {
+        return std::nullopt;
+    }
+
+    std::string wire_data;
+    bool serialized = false;
+    {
+        StageTimer serialize_timer(metrics, MethodMetrics::Stage::serialize);
+        serialized = response.message().SerializeToString(&wire_data);
+    }
+    // The response lives on the arena, so it is released before the arena is reset
+    response = MockResponse();
+    arena.Reset();
+    if (!serialized) {
+        return std::nullopt;
+    }
+
+    grpc::Slice wire_slice(wire_data);
+    return grpc::ByteBuffer(&wire_slice, 1);
+}
+
+auto ResponseCache::build(
+    const google::protobuf::Message& prototype,
+    const std::string& method_name,
+    const std::string& full_path,
+    const std::string& partial_path,
+    google::protobuf::Arena* arena,
+    MethodMetrics* metrics
+) -> MockResponse {
+    std::shared_ptr<const google::protobuf::Message> response;
+    if (!full_path.empty()) {
+        StageTimer load_timer(metrics, MethodMetrics::Stage::load);
+        response = get(prototype, method_name, full_path);
+        if (!response) {
+            return MockResponse();
+        }
+    }
+
+    if (partial_path.empty()) {
+        return response ? MockResponse(std::move(response)) : MockResponse(grpc_mock_server::newMessage(prototype, arena));
+    }
+
+    StageTimer override_timer(metrics, MethodMetrics::Stage::override_apply);
+    auto program = OverrideProgramCache::instance().get(method_name, partial_path);
+    if (!program) {
+        std::cout << "ERROR: unable to compile partial override " << partial_path << std::endl;
+        return MockResponse();
+    }
+
+    auto result = grpc_mock_server::newMessage(prototype, arena);
+    if (response) {
+        result->CopyFrom(*response);
+    }
+    if (!program->apply(*result)) {
+        std::cout << "ERROR: unable to apply partial override " << partial_path << " to " << method_name << std::endl;
+        return MockResponse();
+    }
+    return MockResponse(std::move(result));
+}
+
+auto ResponseCache::build(const google::protobuf::Message& prototype, const std::string& method_name, google::protobuf::Arena* arena)
+    -> MockResponse {
+    // Paths are read from a single snapshot, so a concurrent reload cannot mix two configurations
+    auto config = Config::instance().snapshot();
+    auto method = config->findMethod(method_name);
+    if (method == nullptr) {
+        return build(prototype, method_name, std::string(), std::string(), arena);
+    }
+    return build(prototype, method->m_method_name, method->m_full_path, method->m_partial_path, arena);
+}
+
+void ResponseCache::clear() {
+    std::unique_lock lock(m_mutex);
+    m_entries.clear();
+    m_generation++;
+}
+
+std::size_t ResponseCache::size() const {
+    std::shared_lock lock(m_mutex);
+    return m_entries.size();
+}
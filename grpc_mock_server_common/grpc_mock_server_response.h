@@ -0,0 +1,171 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef GRPC_MOCK_SERVER_RESPONSE_H
+#define GRPC_MOCK_SERVER_RESPONSE_H
+
+#include "grpc_mock_server_export.h"
+#include "grpc_mock_server_fs_utils.h"
+#include "grpc_mock_server_metrics.h"
+
+#include <grpcpp/support/byte_buffer.h>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/message.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace grpc_mock_server {
+
+// Deletes heap allocated messages only, arena messages are freed together with their arena
+struct GRPC_MOCK_SERVER_LIBRARY_API MessageDeleter {
+    void operator()(google::protobuf::Message* message) const;
+};
+
+using MessagePtr = std::unique_ptr<google::protobuf::Message, MessageDeleter>;
+
+// Empty message of the prototype type, allocated on the arena unless it is nullptr.
+// Submessages created later by Reflection, generated accessors or override programs live on the same arena
+GRPC_MOCK_SERVER_LIBRARY_API auto newMessage(const google::protobuf::Message& prototype, google::protobuf::Arena* arena) -> MessagePtr;
+
+// Response files of this size and larger are parsed straight from a read-only memory mapping, the smaller ones are read
+inline constexpr std::size_t kMappedResponseMinSize = 64 * 1024;
+
+// Parse the mock response file, either JSON or binary (see BinaryMock); nullptr if the file cannot be read or parsed.
+// The wire bytes of a binary file are copied to binary_wire if it is not nullptr, so they need not be serialized again.
+// A mapped file must be replaced (written to a new file and renamed) while the server runs, not rewritten in place:
+// the old mapping stays valid after a rename, but truncating the mapped file raises SIGBUS in the parser
+GRPC_MOCK_SERVER_LIBRARY_API auto loadResponse(
+    const google::protobuf::Message& prototype,
+    const std::string& full_path,
+    google::protobuf::Arena* arena,
+    std::optional<std::string>* binary_wire = nullptr
+) -> MessagePtr;
+
+// Load the full response and apply the partial override program of the method, if the partial path is not empty
+GRPC_MOCK_SERVER_LIBRARY_API auto buildResponse(
+    const google::protobuf::Message& prototype,
+    const std::string& method_name,
+    const std::string& full_path,
+    const std::string& partial_path,
+    google::protobuf::Arena* arena
+) -> MessagePtr;
+
+// Arena reused by all the calls served on the current thread.
+// Call Reset() once the response is written: the first block is kept, so small responses do not touch malloc at all
+GRPC_MOCK_SERVER_LIBRARY_API auto threadArena() -> google::protobuf::Arena&;
+
+} // grpc_mock_server
+
+// Response of a single call: either the shared cached full response, when no partial override applies,
+// or a private copy with the override applied
+class GRPC_MOCK_SERVER_LIBRARY_API MockResponse {
+    std::shared_ptr<const google::protobuf::Message> m_shared;
+    grpc_mock_server::MessagePtr m_modified;
+
+public:
+    MockResponse() = default;
+    explicit MockResponse(std::shared_ptr<const google::protobuf::Message> shared);
+    explicit MockResponse(grpc_mock_server::MessagePtr modified);
+
+    explicit operator bool() const;
+    bool isShared() const;
+    const google::protobuf::Message& message() const;
+};
+
+// Full responses parsed once per method key, e.g. "fixed_price_1234.routeguide.RouteGuide/GetFeature".
+// Entry is reparsed when the method is bound to another file, after clear(),
+// or when the file modification time changes if the cache checks it (CacheInvalidation::write_time)
+class GRPC_MOCK_SERVER_LIBRARY_API ResponseCache {
+    struct CachedResponse {
+        std::shared_ptr<const google::protobuf::Message> m_message;
+        // Serialized once, ByteBuffer copies share the reference counted slice
+        grpc::Slice m_wire_slice;
+        grpc::ByteBuffer m_wire;
+    };
+    struct Entry {
+        std::string m_path;
+        std::filesystem::file_time_type m_write_time;
+        std::shared_ptr<const CachedResponse> m_response;
+    };
+    using MethodName = std::string;
+    using Entries = std::unordered_map<MethodName, Entry>;
+
+    grpc_mock_server::CacheInvalidation m_invalidation;
+    mutable std::shared_mutex m_mutex;
+    Entries m_entries;
+    // Incremented by clear(): a file read before the clear() is not cached after it
+    std::uint64_t m_generation = 0;
+
+public:
+    explicit ResponseCache(grpc_mock_server::CacheInvalidation invalidation = grpc_mock_server::CacheInvalidation::clear);
+
+    // Process-wide cache, cleared by ConfigWatcher when a mock file changes
+    static ResponseCache& instance();
+
+    // Shared parsed full response, must not be modified; nullptr if the file cannot be read or parsed
+    auto get(const google::protobuf::Message& prototype, const std::string& method_name, const std::string& full_path)
+        -> std::shared_ptr<const google::protobuf::Message>;
+
+    // Wire bytes of the shared full response, to be written out without serializing the message again
+    auto getWire(const google::protobuf::Message& prototype, const std::string& method_name, const std::string& full_path)
+        -> std::optional<grpc::ByteBuffer>;
+
+    // Wire bytes of the response with the partial override applied, if the partial path is not empty.
+    // Overrides of singular scalar fields are appended to the cached wire bytes as a patch without copying them,
+    // other overrides are applied to a copy of the cached response, which is serialized then.
+    // Load, override and serialization times are recorded to the metrics if they are not nullptr
+    auto buildWire(
+        const google::protobuf::Message& prototype,
+        const std::string& method_name,
+        const std::string& full_path,
+        const std::string& partial_path,
+        MethodMetrics* metrics = nullptr
+    ) -> std::optional<grpc::ByteBuffer>;
+
+    // The cached response is cloned into the arena only when the partial path is not empty
+    auto build(
+        const google::protobuf::Message& prototype,
+        const std::string& method_name,
+        const std::string& full_path,
+        const std::string& partial_path,
+        google::protobuf::Arena* arena,
+        MethodMetrics* metrics = nullptr
+    ) -> MockResponse;
+
+    // Paths are taken from Config::instance()
+    auto build(const google::protobuf::Message& prototype, const std::string& method_name, google::protobuf::Arena* arena) -> MockResponse;
+
+    void clear();
+    std::size_t size() const;
+
+private:
+    auto lookup(const google::protobuf::Message& prototype, const std::string& method_name, const std::string& full_path)
+        -> std::shared_ptr<const CachedResponse>;
+
+    ResponseCache(const ResponseCache& root) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+};
+
+#endif // GRPC_MOCK_SERVER_RESPONSE_H
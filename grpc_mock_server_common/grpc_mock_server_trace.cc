@@ -0,0 +1,77 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "grpc_mock_server_trace.h"
+
+#include <google/protobuf/util/json_util.h>
+
+namespace grpc_mock_server {
+
+auto messageToJson(const google::protobuf::Message& message) -> std::string {
+    // Empty message would be rendered as "{}"
+    if (message.ByteSizeLong() == 0) {
+        return std::string();
+    }
+
+    std::string json;
+    google::protobuf::util::JsonPrintOptions options;
+    google::protobuf::util::MessageToJsonString(message, &json, options);
+    return json;
+}
+
+} // grpc_mock_server
+
+LazyMessageJson::LazyMessageJson(std::shared_ptr<const google::protobuf::Message> message)
+    : m_message(std::move(message)) {
+}
+
+LazyMessageJson::LazyMessageJson(const google::protobuf::Message& prototype, std::string wire)
+    : m_prototype(&prototype), m_wire(std::move(wire)) {
+}
+
+auto LazyMessageJson::copyMessage(const google::protobuf::Message& message) -> std::shared_ptr<const google::protobuf::Message> {
+    std::shared_ptr<google::protobuf::Message> result(message.New());
+    result->CopyFrom(message);
+    return result;
+}
+
+bool LazyMessageJson::empty() const {
+    if (m_message) {
+        return m_message->ByteSizeLong() == 0;
+    }
+    return m_wire.empty();
+}
+
+auto LazyMessageJson::json() const -> const std::string& {
+    if (m_json.has_value()) {
+        return m_json.value();
+    }
+
+    if (m_message) {
+        m_json = grpc_mock_server::messageToJson(*m_message);
+    }
+    else if (m_prototype != nullptr && !m_wire.empty()) {
+        std::unique_ptr<google::protobuf::Message> message(m_prototype->New());
+        m_json = message->ParseFromString(m_wire) ? grpc_mock_server::messageToJson(*message) : std::string();
+    }
+    else {
+        m_json = std::string();
+    }
+    return m_json.value();
+}
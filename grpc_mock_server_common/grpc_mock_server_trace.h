@@ -0,0 +1,74 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef GRPC_MOCK_SERVER_TRACE_H
+#define GRPC_MOCK_SERVER_TRACE_H
+
+#include "grpc_mock_server_export.h"
+
+#include <google/protobuf/message.h>
+
+#include <ctime>
+#include <memory>
+#include <optional>
+#include <string>
+
+class MethodMetrics;
+
+namespace grpc_mock_server {
+
+// JSON of the message, empty string for the empty message; the check is ByteSizeLong() == 0, nothing is rendered for it
+GRPC_MOCK_SERVER_LIBRARY_API auto messageToJson(const google::protobuf::Message& message) -> std::string;
+
+} // grpc_mock_server
+
+// Message of a traced call, JSON is rendered on the first json() call only,
+// so the traces dropped by sampling or level filtering cost a pointer copy (or the wire bytes copy)
+class GRPC_MOCK_SERVER_LIBRARY_API LazyMessageJson {
+    std::shared_ptr<const google::protobuf::Message> m_message;
+    // Serialized message of the m_prototype type, parsed on demand
+    const google::protobuf::Message* m_prototype = nullptr;
+    std::string m_wire;
+    mutable std::optional<std::string> m_json;
+
+public:
+    LazyMessageJson() = default;
+    // Message must not be modified after the call, use copyMessage() for the messages owned by the RPC
+    explicit LazyMessageJson(std::shared_ptr<const google::protobuf::Message> message);
+    LazyMessageJson(const google::protobuf::Message& prototype, std::string wire);
+
+    static auto copyMessage(const google::protobuf::Message& message) -> std::shared_ptr<const google::protobuf::Message>;
+
+    bool empty() const;
+    // Not thread safe: the first call caches the result
+    auto json() const -> const std::string&;
+};
+
+// Single traced method call
+struct CallTrace {
+    time_t m_time = 0;
+    std::string m_method;
+    LazyMessageJson m_request;
+    int m_status = 0;
+    LazyMessageJson m_response;
+    // Time spent in the log callback is recorded to the method metrics if they are set
+    MethodMetrics* m_metrics = nullptr;
+};
+
+#endif // GRPC_MOCK_SERVER_TRACE_H
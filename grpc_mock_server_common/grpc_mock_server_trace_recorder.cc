@@ -0,0 +1,406 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "grpc_mock_server_trace_recorder.h"
+#include "grpc_mock_server_fs_utils.h"
+
+#include <google/protobuf/struct.pb.h>
+#include <google/protobuf/util/json_util.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char kFileMagic[8] = { 'G', 'M', 'S', 'T', 'R', 'A', 'C', 'E' };
+
+constexpr auto alignedRecordSize(std::size_t payload_size) -> std::uint64_t {
+    return (sizeof(TraceRecorder::RecordHeader) + payload_size + 7) & ~std::uint64_t(7);
+}
+
+// Copy from the ring at the stream offset, wrapping around the ring end
+void readRing(const std::byte* ring, std::uint64_t capacity, std::uint64_t offset, void* data, std::size_t size) {
+    auto position = offset % capacity;
+    auto first_size = std::min<std::uint64_t>(size, capacity - position);
+    std::memcpy(data, ring + position, first_size);
+    std::memcpy(static_cast<std::byte*>(data) + first_size, ring, size - first_size);
+}
+
+} // anonymous namespace
+
+TraceRecorder::~TraceRecorder() {
+    close();
+}
+
+bool TraceRecorder::open(const std::filesystem::path& path, std::size_t capacity) {
+    close();
+
+    capacity = (capacity + 7) & ~std::size_t(7);
+    if (capacity < sizeof(RecordHeader)) {
+        return false;
+    }
+    auto mapping_size = kRingOffset + capacity;
+
+#if defined(_WIN32) || defined(_WIN64)
+    auto file = ::CreateFileW(
+        path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr
+    );
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cout << "ERROR: unable to create trace file " << path << std::endl;
+        return false;
+    }
+    // The mapping grows the file to the mapping size and keeps it open
+    auto mapping_size64 = static_cast<std::uint64_t>(mapping_size);
+    auto mapping_handle = ::CreateFileMappingW(
+        file, nullptr, PAGE_READWRITE, static_cast<DWORD>(mapping_size64 >> 32), static_cast<DWORD>(mapping_size64), nullptr
+    );
+    ::CloseHandle(file);
+    if (mapping_handle == nullptr) {
+        std::cout << "ERROR: unable to resize trace file " << path << std::endl;
+        return false;
+    }
+    auto mapping = ::MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, mapping_size);
+    if (mapping == nullptr) {
+        std::cout << "ERROR: unable to map trace file " << path << std::endl;
+        ::CloseHandle(mapping_handle);
+        return false;
+    }
+
+    m_mapping = static_cast<std::byte*>(mapping);
+    m_mapping_size = mapping_size;
+    m_mapping_handle = mapping_handle;
+#else
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cout << "ERROR: unable to create trace file " << path << std::endl;
+        return false;
+    }
+    if (::ftruncate(fd, static_cast<off_t>(mapping_size)) != 0) {
+        std::cout << "ERROR: unable to resize trace file " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* mapping = ::mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // Mapping keeps the file open
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        std::cout << "ERROR: unable to map trace file " << path << std::endl;
+        return false;
+    }
+
+    m_mapping = static_cast<std::byte*>(mapping);
+    m_mapping_size = mapping_size;
+#endif
+
+    m_header = reinterpret_cast<FileHeader*>(m_mapping);
+    m_methods = reinterpret_cast<MethodEntry*>(m_mapping + sizeof(FileHeader));
+    m_ring = m_mapping + kRingOffset;
+    m_capacity = capacity;
+
+    std::memcpy(m_header->m_magic, kFileMagic, sizeof(kFileMagic));
+    m_header->m_version = kVersion;
+    m_header->m_method_count = 0;
+    m_header->m_capacity = capacity;
+    m_header->m_write_offset = 0;
+
+    std::lock_guard lock(m_methods_mutex);
+    m_method_ids.clear();
+    return true;
+}
+
+void TraceRecorder::close() {
+    if (m_mapping == nullptr) {
+        return;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    ::UnmapViewOfFile(m_mapping);
+    ::CloseHandle(m_mapping_handle);
+    m_mapping_handle = nullptr;
+#else
+    ::munmap(m_mapping, m_mapping_size);
+#endif
+    m_mapping = nullptr;
+    m_mapping_size = 0;
+    m_header = nullptr;
+    m_methods = nullptr;
+    m_ring = nullptr;
+    m_capacity = 0;
+}
+
+bool TraceRecorder::isOpen() const {
+    return m_mapping != nullptr;
+}
+
+auto TraceRecorder::registerMethod(std::string_view method) -> std::optional<MethodId> {
+    std::lock_guard lock(m_methods_mutex);
+    if (m_header == nullptr || method.size() > kMaxMethodNameSize) {
+        return std::nullopt;
+    }
+
+    auto it = m_method_ids.find(std::string(method));
+    if (it != m_method_ids.end()) {
+        return it->second;
+    }
+    if (m_method_ids.size() == kMaxMethods) {
+        return std::nullopt;
+    }
+
+    auto method_id = static_cast<MethodId>(m_method_ids.size());
+    auto& entry = m_methods[method_id];
+    entry.m_size = static_cast<std::uint32_t>(method.size());
+    std::memcpy(entry.m_name, method.data(), method.size());
+    std::atomic_ref(m_header->m_method_count).store(method_id + 1, std::memory_order_release);
+    m_method_ids.emplace(method, method_id);
+    return method_id;
+}
+
+auto TraceRecorder::reserve(std::size_t payload_size) -> std::optional<std::uint64_t> {
+    auto record_size = alignedRecordSize(payload_size);
+    if (m_header == nullptr || record_size > m_capacity) {
+        return std::nullopt;
+    }
+    return std::atomic_ref(m_header->m_write_offset).fetch_add(record_size, std::memory_order_relaxed);
+}
+
+void TraceRecorder::write(std::uint64_t offset, const void* data, std::size_t size) {
+    auto position = offset % m_capacity;
+    auto first_size = std::min<std::uint64_t>(size, m_capacity - position);
+    std::memcpy(m_ring + position, data, first_size);
+    std::memcpy(m_ring, static_cast<const std::byte*>(data) + first_size, size - first_size);
+}
+
+auto TraceRecorder::contiguous(std::uint64_t offset, std::size_t size) -> std::byte* {
+    auto position = offset % m_capacity;
+    return position + size <= m_capacity ? m_ring + position : nullptr;
+}
+
+void TraceRecorder::publish(std::uint64_t offset, const RecordHeader& header) {
+    // Header never wraps: records start at 8 byte aligned positions, so the magic is always contiguous and aligned
+    write(offset, &header, sizeof(header));
+    auto magic = reinterpret_cast<std::uint32_t*>(m_ring + offset % m_capacity);
+    std::atomic_ref(*magic).store(kRecordMagic, std::memory_order_release);
+}
+
+bool TraceRecorder::record(time_t time, MethodId method_id, int status, std::string_view request, std::string_view response) {
+    auto offset = reserve(request.size() + response.size());
+    if (!offset.has_value()) {
+        return false;
+    }
+
+    auto payload_offset = offset.value() + sizeof(RecordHeader);
+    write(payload_offset, request.data(), request.size());
+    write(payload_offset + request.size(), response.data(), response.size());
+    publish(offset.value(), RecordHeader(
+        0,
+        method_id,
+        offset.value(),
+        static_cast<std::int64_t>(time),
+        status,
+        static_cast<std::uint32_t>(request.size()),
+        static_cast<std::uint32_t>(response.size()),
+        0
+    ));
+    return true;
+}
+
+bool TraceRecorder::record(
+    time_t time,
+    MethodId method_id,
+    int status,
+    const google::protobuf::Message& request,
+    const google::protobuf::Message& response
+) {
+    auto request_size = request.ByteSizeLong();
+    auto response_size = response.ByteSizeLong();
+    auto offset = reserve(request_size + response_size);
+    if (!offset.has_value()) {
+        return false;
+    }
+
+    auto payload_offset = offset.value() + sizeof(RecordHeader);
+    auto payload = contiguous(payload_offset, request_size + response_size);
+    if (payload != nullptr) {
+        auto request_end = request.SerializeWithCachedSizesToArray(reinterpret_cast<std::uint8_t*>(payload));
+        response.SerializeWithCachedSizesToArray(request_end);
+    }
+    else {
+        auto request_data = request.SerializeAsString();
+        auto response_data = response.SerializeAsString();
+        write(payload_offset, request_data.data(), request_data.size());
+        write(payload_offset + request_data.size(), response_data.data(), response_data.size());
+    }
+    publish(offset.value(), RecordHeader(
+        0,
+        method_id,
+        offset.value(),
+        static_cast<std::int64_t>(time),
+        status,
+        static_cast<std::uint32_t>(request_size),
+        static_cast<std::uint32_t>(response_size),
+        0
+    ));
+    return true;
+}
+
+std::uint64_t TraceRecorder::writeOffset() const {
+    return m_header != nullptr ? std::atomic_ref(m_header->m_write_offset).load(std::memory_order_relaxed) : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace grpc_mock_server {
+
+namespace {
+
+struct MethodTypes {
+    std::string m_name;
+    const google::protobuf::Message* m_request = nullptr;
+    const google::protobuf::Message* m_response = nullptr;
+};
+
+auto findMethodTypes(std::string name, const google::protobuf::DescriptorPool& pool, google::protobuf::MessageFactory& factory)
+    -> MethodTypes {
+    MethodTypes result(name);
+
+    // "/package.Service/Method" -> "package.Service.Method"
+    if (name.starts_with('/')) {
+        name.erase(0, 1);
+    }
+    auto slash_pos = name.rfind('/');
+    if (slash_pos != std::string::npos) {
+        name[slash_pos] = '.';
+    }
+    auto method_descriptor = pool.FindMethodByName(name);
+    if (method_descriptor != nullptr) {
+        result.m_request = factory.GetPrototype(method_descriptor->input_type());
+        result.m_response = factory.GetPrototype(method_descriptor->output_type());
+    }
+    return result;
+}
+
+void writeMessageJson(const google::protobuf::Message* prototype, std::string_view data, std::ostream& output) {
+    std::unique_ptr<google::protobuf::Message> message(prototype != nullptr ? prototype->New() : nullptr);
+    std::string json;
+    if (!message || !message->ParseFromArray(data.data(), static_cast<int>(data.size()))
+        || !google::protobuf::util::MessageToJsonString(*message, &json).ok()) {
+        output << "null";
+        return;
+    }
+    output << json;
+}
+
+// Method names come from the recorded calls, so they are escaped by the protobuf JSON writer like the messages
+void writeStringJson(const std::string& value, std::ostream& output) {
+    google::protobuf::Value string_value;
+    string_value.set_string_value(value);
+    std::string json;
+    if (!google::protobuf::util::MessageToJsonString(string_value, &json).ok()) {
+        output << "null";
+        return;
+    }
+    output << json;
+}
+
+} // anonymous namespace
+
+bool decodeTrace(
+    const std::filesystem::path& path,
+    const google::protobuf::DescriptorPool& pool,
+    google::protobuf::MessageFactory& factory,
+    std::ostream& output
+) {
+    auto trace_file = MappedFile::open(path, MappedFile::Access::random);
+    if (!trace_file.has_value()) {
+        return false;
+    }
+    auto data = trace_file->view();
+
+    TraceRecorder::FileHeader header;
+    if (data.size() < TraceRecorder::kRingOffset) {
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.m_magic, kFileMagic, sizeof(kFileMagic)) != 0 || header.m_version != TraceRecorder::kVersion
+        || header.m_capacity == 0 || header.m_capacity % 8 != 0 || data.size() < TraceRecorder::kRingOffset + header.m_capacity
+        || header.m_method_count > TraceRecorder::kMaxMethods) {
+        return false;
+    }
+
+    std::vector<MethodTypes> methods;
+    methods.reserve(header.m_method_count);
+    for (std::uint32_t i = 0; i < header.m_method_count; i++) {
+        TraceRecorder::MethodEntry entry;
+        std::memcpy(&entry, data.data() + sizeof(TraceRecorder::FileHeader) + i * sizeof(entry), sizeof(entry));
+        auto name_size = std::min<std::size_t>(entry.m_size, TraceRecorder::kMaxMethodNameSize);
+        methods.push_back(findMethodTypes(std::string(entry.m_name, name_size), pool, factory));
+    }
+
+    auto ring = reinterpret_cast<const std::byte*>(data.data() + TraceRecorder::kRingOffset);
+    auto capacity = header.m_capacity;
+    auto end_offset = header.m_write_offset;
+    // Ring may start in the middle of an overwritten record: look for a header written at its own offset
+    auto offset = end_offset > capacity ? end_offset - capacity : 0;
+    std::string payload;
+    while (offset + sizeof(TraceRecorder::RecordHeader) <= end_offset) {
+        TraceRecorder::RecordHeader record;
+        readRing(ring, capacity, offset, &record, sizeof(record));
+        auto payload_size = std::uint64_t(record.m_request_size) + record.m_response_size;
+        auto record_size = alignedRecordSize(payload_size);
+        if (record.m_magic != TraceRecorder::kRecordMagic || record.m_offset != offset || offset + record_size > end_offset) {
+            offset += 8;
+            continue;
+        }
+
+        payload.resize(payload_size);
+        readRing(ring, capacity, offset + sizeof(record), payload.data(), payload.size());
+        auto request = std::string_view(payload).substr(0, record.m_request_size);
+        auto response = std::string_view(payload).substr(record.m_request_size);
+
+        const MethodTypes* method = record.m_method_id < methods.size() ? &methods[record.m_method_id] : nullptr;
+        output << "{\"time\":" << record.m_time << ",\"method\":";
+        writeStringJson(method != nullptr ? method->m_name : std::string(), output);
+        output << ",\"status\":" << record.m_status << ",\"request\":";
+        writeMessageJson(method != nullptr ? method->m_request : nullptr, request, output);
+        output << ",\"response\":";
+        writeMessageJson(method != nullptr ? method->m_response : nullptr, response, output);
+        output << "}\n";
+
+        offset += record_size;
+    }
+    return true;
+}
+
+} // grpc_mock_server
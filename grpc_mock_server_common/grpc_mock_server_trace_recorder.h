@@ -0,0 +1,153 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef GRPC_MOCK_SERVER_TRACE_RECORDER_H
+#define GRPC_MOCK_SERVER_TRACE_RECORDER_H
+
+#include "grpc_mock_server_export.h"
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Binary record of every method call, appended to a memory mapped ring file:
+//
+//     TraceRecorder recorder;
+//     recorder.open("calls.gmstrace", 256 * 1024 * 1024);
+//     auto method_id = recorder.registerMethod("/routeguide.RouteGuide/GetFeature");
+//     recorder.record(current_unix_time(), method_id.value(), 0, request, response);
+//
+// Writers are lock free: the space is reserved with a single atomic add, the record is copied into the mapping
+// and published by storing its magic last. When the ring wraps, the oldest records are overwritten;
+// a writer lapped by the others while copying leaves a torn record, which the decoder skips.
+// File is rendered to JSON lines with grpc_mock_server::decodeTrace() or the trace decoder tool
+class GRPC_MOCK_SERVER_LIBRARY_API TraceRecorder {
+public:
+    using MethodId = std::uint32_t;
+
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::size_t kMaxMethods = 4096;
+    static constexpr std::size_t kMaxMethodNameSize = 252;
+    static constexpr std::uint32_t kRecordMagic = 0x52534D47; // "GMSR"
+
+    // File layout: header, method table, ring; integers are in the host byte order
+    struct FileHeader {
+        char m_magic[8];                 // "GMSTRACE"
+        std::uint32_t m_version;
+        std::uint32_t m_method_count;
+        std::uint64_t m_capacity;        // ring size in bytes, multiple of 8
+        std::uint64_t m_write_offset;    // bytes ever reserved in the ring, position is m_write_offset % m_capacity
+    };
+
+    struct MethodEntry {
+        std::uint32_t m_size;
+        char m_name[kMaxMethodNameSize];
+    };
+
+    // Records start at 8 byte aligned positions and are padded to 8 bytes, the payload follows the header:
+    // serialized request, then serialized response
+    struct RecordHeader {
+        std::uint32_t m_magic;           // kRecordMagic once the record is complete
+        MethodId m_method_id;
+        std::uint64_t m_offset;          // ring offset the record was reserved at, tells stale data from the record
+        std::int64_t m_time;
+        std::int32_t m_status;
+        std::uint32_t m_request_size;
+        std::uint32_t m_response_size;
+        std::uint32_t m_reserved;
+    };
+
+    static constexpr std::size_t kRingOffset = sizeof(FileHeader) + kMaxMethods * sizeof(MethodEntry);
+
+private:
+    std::byte* m_mapping = nullptr;
+    std::size_t m_mapping_size = 0;
+#if defined(_WIN32) || defined(_WIN64)
+    void* m_mapping_handle = nullptr;
+#endif
+    FileHeader* m_header = nullptr;
+    MethodEntry* m_methods = nullptr;
+    std::byte* m_ring = nullptr;
+    std::uint64_t m_capacity = 0;
+
+    // Registration only, record() never takes it
+    std::mutex m_methods_mutex;
+    std::unordered_map<std::string, MethodId> m_method_ids;
+
+public:
+    TraceRecorder() = default;
+    ~TraceRecorder();
+
+    // Creates or truncates the file, capacity is rounded up to 8 bytes; false if the file cannot be mapped
+    bool open(const std::filesystem::path& path, std::size_t capacity);
+    void close();
+    bool isOpen() const;
+
+    // Same id for the same name; nullopt if the name is too long or the method table is full
+    auto registerMethod(std::string_view method) -> std::optional<MethodId>;
+
+    // False if the recorder is closed or the record does not fit into the ring
+    bool record(time_t time, MethodId method_id, int status, std::string_view request, std::string_view response);
+    // Messages are serialized straight into the mapping unless the record wraps around the ring end
+    bool record(
+        time_t time,
+        MethodId method_id,
+        int status,
+        const google::protobuf::Message& request,
+        const google::protobuf::Message& response
+    );
+
+    std::uint64_t writeOffset() const;
+
+private:
+    auto reserve(std::size_t payload_size) -> std::optional<std::uint64_t>;
+    void write(std::uint64_t offset, const void* data, std::size_t size);
+    auto contiguous(std::uint64_t offset, std::size_t size) -> std::byte*;
+    void publish(std::uint64_t offset, const RecordHeader& header);
+
+    TraceRecorder(const TraceRecorder& root) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+};
+
+namespace grpc_mock_server {
+
+// Writes every complete record of the trace file as a JSON line:
+//     {"time":..., "method":"/package.Service/Method", "status":0, "request":{...}, "response":{...}}
+// Message types are looked up in the pool by the method name, messages of unknown methods are written as null;
+// false if the file is not a trace file
+GRPC_MOCK_SERVER_LIBRARY_API bool decodeTrace(
+    const std::filesystem::path& path,
+    const google::protobuf::DescriptorPool& pool,
+    google::protobuf::MessageFactory& factory,
+    std::ostream& output
+);
+
+} // grpc_mock_server
+
+#endif // GRPC_MOCK_SERVER_TRACE_RECORDER_H
@@ -0,0 +1,56 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "grpc_mock_server_typed_fields.h"
+
+#include <mutex>
+
+TypedFieldRegistry& TypedFieldRegistry::instance() {
+    static TypedFieldRegistry instance;
+    return instance;
+}
+
+void TypedFieldRegistry::add(const google::protobuf::Descriptor* descriptor, int field_number, TypedField field) {
+    std::unique_lock lock(m_mutex);
+    m_messages[descriptor][field_number] = field;
+}
+
+auto TypedFieldRegistry::find(const google::protobuf::Descriptor* descriptor, int field_number) const -> TypedField {
+    std::shared_lock lock(m_mutex);
+    auto message_it = m_messages.find(descriptor);
+    if (message_it == m_messages.end()) {
+        return TypedField();
+    }
+
+    auto field_it = message_it->second.find(field_number);
+    return field_it != message_it->second.end() ? field_it->second : TypedField();
+}
+
+std::size_t TypedFieldRegistry::size() const {
+    std::shared_lock lock(m_mutex);
+    std::size_t result = 0;
+    for (const auto& [descriptor, fields] : m_messages) {
+        result += fields.size();
+    }
+    return result;
+}
+
+void TypedFieldRegistry::clear() {
+    std::unique_lock lock(m_mutex);
+    m_messages.clear();
+}
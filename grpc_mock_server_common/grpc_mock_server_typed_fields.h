@@ -0,0 +1,194 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef GRPC_MOCK_SERVER_TYPED_FIELDS_H
+#define GRPC_MOCK_SERVER_TYPED_FIELDS_H
+
+#include "grpc_mock_server_export.h"
+#include "grpc_mock_server_message_wrapper.h"
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/generated_enum_reflection.h>
+#include <google/protobuf/message.h>
+
+#include <cassert>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
+// Direct accessors of a generated message field, used instead of google::protobuf::Reflection
+struct GRPC_MOCK_SERVER_LIBRARY_API TypedField {
+    // Returns false if the value type does not match the field, the caller falls back to Reflection then
+    using Setter = bool (*)(google::protobuf::Message& message, const MessageWrapper::ValueView& value);
+    using MutableMessage = google::protobuf::Message* (*)(google::protobuf::Message& message);
+
+    Setter setter = nullptr;
+    MutableMessage mutable_message = nullptr;
+};
+
+// Generated accessors of the hot message types, keyed by message descriptor and field number:
+//
+//     auto& registry = TypedFieldRegistry::instance();
+//     registry.add<&routeguide::RouteSummary::set_point_count>(routeguide::RouteSummary::kPointCountFieldNumber);
+//     registry.add<&routeguide::Feature::mutable_name>(routeguide::Feature::kNameFieldNumber);
+//     registry.add<&routeguide::Feature::mutable_location>(routeguide::Feature::kLocationFieldNumber);
+//
+// Accessors are looked up once, when CompiledOverrideProgram binds to the message type,
+// so the registration must be done at startup, before the first override is applied.
+// Only singular fields are supported; messages with the registered descriptor must be instances of the generated class
+class GRPC_MOCK_SERVER_LIBRARY_API TypedFieldRegistry {
+    using FieldNumber = int;
+    using Fields = std::unordered_map<FieldNumber, TypedField>;
+
+    mutable std::shared_mutex m_mutex;
+    std::unordered_map<const google::protobuf::Descriptor*, Fields> m_messages;
+
+    template <typename Accessor>
+    struct AccessorTraits;
+
+    // void set_foo(T value)
+    template <typename MessageType, typename ValueType>
+    struct AccessorTraits<void (MessageType::*)(ValueType)> {
+        using Message = MessageType;
+        using Value = ValueType;
+    };
+
+    // std::string* mutable_foo() or SubMessage* mutable_foo()
+    template <typename MessageType, typename ValueType>
+    struct AccessorTraits<ValueType* (MessageType::*)()> {
+        using Message = MessageType;
+        using Value = ValueType;
+    };
+
+public:
+    TypedFieldRegistry() = default;
+
+    // Process-wide registry used by CompiledOverrideProgram
+    static TypedFieldRegistry& instance();
+
+    // Accessor is either setter of a scalar or enum field, or mutable accessor of a string or message field
+    template <auto Accessor>
+    void add(int field_number);
+
+    // Both accessors are nullptr if the field is not registered
+    auto find(const google::protobuf::Descriptor* descriptor, int field_number) const -> TypedField;
+    std::size_t size() const;
+    void clear();
+
+private:
+    void add(const google::protobuf::Descriptor* descriptor, int field_number, TypedField field);
+
+    template <auto Accessor>
+    static bool setValue(google::protobuf::Message& message, const MessageWrapper::ValueView& value);
+
+    template <auto Accessor>
+    static google::protobuf::Message* mutableMessage(google::protobuf::Message& message);
+
+    TypedFieldRegistry(const TypedFieldRegistry& root) = delete;
+    TypedFieldRegistry& operator=(const TypedFieldRegistry&) = delete;
+};
+
+template <auto Accessor>
+void TypedFieldRegistry::add(int field_number) {
+    using Traits = AccessorTraits<decltype(Accessor)>;
+    using MessageType = typename Traits::Message;
+    using ValueType = std::remove_cvref_t<typename Traits::Value>;
+
+    auto descriptor = MessageType::descriptor();
+    auto field_descriptor = descriptor->FindFieldByNumber(field_number);
+    assert(field_descriptor != nullptr);
+    assert(!field_descriptor->is_repeated());
+
+    TypedField field;
+    if constexpr (std::is_base_of_v<google::protobuf::Message, ValueType>) {
+        assert(field_descriptor->cpp_type() == google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE);
+        field.mutable_message = &mutableMessage<Accessor>;
+    }
+    else {
+        assert(field_descriptor->cpp_type() != google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE);
+        field.setter = &setValue<Accessor>;
+    }
+    add(descriptor, field_number, field);
+}
+
+template <auto Accessor>
+bool TypedFieldRegistry::setValue(google::protobuf::Message& message, const MessageWrapper::ValueView& value) {
+    using Traits = AccessorTraits<decltype(Accessor)>;
+    using MessageType = typename Traits::Message;
+    using ValueType = std::remove_cvref_t<typename Traits::Value>;
+
+    assert(dynamic_cast<MessageType*>(&message) != nullptr);
+    auto& typed_message = static_cast<MessageType&>(message);
+
+    if constexpr (std::is_same_v<ValueType, std::string>) {
+        if (!std::holds_alternative<std::string_view>(value)) {
+            return false;
+        }
+        (typed_message.*Accessor)()->assign(std::get<std::string_view>(value));
+    }
+    else if constexpr (std::is_enum_v<ValueType>) {
+        std::string_view value_string;
+        if (std::holds_alternative<MessageWrapper::EnumView>(value)) {
+            value_string = std::get<MessageWrapper::EnumView>(value).name;
+        }
+        else if (std::holds_alternative<std::string_view>(value)) {
+            value_string = std::get<std::string_view>(value);
+        }
+        else {
+            return false;
+        }
+
+        auto enum_value_descriptor = google::protobuf::GetEnumDescriptor<ValueType>()->FindValueByName(std::string(value_string));
+        if (enum_value_descriptor == nullptr) {
+            return false;
+        }
+        (typed_message.*Accessor)(static_cast<ValueType>(enum_value_descriptor->number()));
+    }
+    else if constexpr (std::is_same_v<ValueType, bool>) {
+        if (!std::holds_alternative<bool>(value)) {
+            return false;
+        }
+        (typed_message.*Accessor)(std::get<bool>(value));
+    }
+    else if constexpr (std::is_floating_point_v<ValueType>) {
+        if (!std::holds_alternative<double>(value)) {
+            return false;
+        }
+        (typed_message.*Accessor)(static_cast<ValueType>(std::get<double>(value)));
+    }
+    else {
+        static_assert(std::is_integral_v<ValueType>, "unsupported field type");
+        if (!std::holds_alternative<int64_t>(value)) {
+            return false;
+        }
+        (typed_message.*Accessor)(static_cast<ValueType>(std::get<int64_t>(value)));
+    }
+    return true;
+}
+
+template <auto Accessor>
+google::protobuf::Message* TypedFieldRegistry::mutableMessage(google::protobuf::Message& message) {
+    using MessageType = typename AccessorTraits<decltype(Accessor)>::Message;
+
+    assert(dynamic_cast<MessageType*>(&message) != nullptr);
+    return (static_cast<MessageType&>(message).*Accessor)();
+}
+
+#endif // GRPC_MOCK_SERVER_TYPED_FIELDS_H
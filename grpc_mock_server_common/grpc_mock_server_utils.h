@@ -40,7 +40,12 @@
 CMRC_DECLARE(grpc_mock_server);
 
 // Internal
+#include "grpc_mock_server_configuration.h"
 #include "grpc_mock_server_message_wrapper.h"
+#include "grpc_mock_server_request_language.h"
+#include "grpc_mock_server_override_program.h"
+#include "grpc_mock_server_response.h"
+#include "grpc_mock_server_trace.h"
 #include "grpc_mock_server_fs_utils.h"
 
 inline std::string ToString(const grpc::string_ref& r) {
@@ -84,16 +89,9 @@ inline time_t current_unix_time() {
 
 // ----------------------------------------------------------------------------------------------------------------------------------------
 
+// Prefer LazyMessageJson for tracing: the JSON is rendered only if it is written
 inline std::string message_as_json(const google::protobuf::Message& message) {
-    std::string json;
-    google::protobuf::util::JsonPrintOptions options;
-    //options.add_whitespace = true;
-    google::protobuf::util::MessageToJsonString(message, &json, options);
-    trim(json);
-    if (json != "{}") {
-        return json;
-    }
-    return "";
+    return grpc_mock_server::messageToJson(message);
 }
 
 void grpcMockServerMethodCallback(
@@ -105,10 +103,17 @@ void grpcMockServerMethodCallback(
 );
 
 inline void evalRequest(const google::protobuf::Message& root_message, const std::string& request_data) {
-    auto rc_fs = cmrc::grpc_mock_server::get_filesystem();
-    auto grammar_file = rc_fs.open("assets/request_grammar.txt");
-    auto grammar_data = std::string(grammar_file.cbegin(), grammar_file.cend());
-    MessageWrapper::eval(root_message, grammar_data, request_data);
+    MessageWrapper::eval(root_message, RequestLanguage::instance(), request_data);
+}
+
+// Apply the partial override file of the method, compiled program is cached until the file changes
+inline bool evalRequestFile(const google::protobuf::Message& root_message, const std::string& method_name, const std::string& request_path) {
+    auto program = OverrideProgramCache::instance().get(method_name, request_path);
+    if (!program) {
+        return false;
+    }
+    MessageWrapper::eval(root_message, *program);
+    return true;
 }
 
 inline grpc::Status fromUtilStatus(const google::protobuf::util::status_internal::Status& status) {
@@ -203,4 +208,20 @@ inline std::string getDatasetName(::grpc::ServerContextBase* context) {
     return dataset_name_with_dot;
 }
 
+// Dataset name without dot pointing into the client metadata, empty if it is not set
+inline std::string_view getDatasetNameView(::grpc::ServerContextBase* context) {
+    const auto& client_metadata = context->client_metadata();
+    auto dataset_it = client_metadata.find("gms_dataset");
+    if (dataset_it == client_metadata.end()) {
+        return std::string_view();
+    }
+    return std::string_view(dataset_it->second.data(), dataset_it->second.size());
+}
+
+// Interned id of the gms_dataset metadata value, requests without the metadata use the dataset with empty name;
+// nothing is allocated. nullopt if the config has no such dataset
+inline auto getDatasetId(const ConfigSnapshot& config, ::grpc::ServerContextBase* context) -> std::optional<ConfigSnapshot::DatasetId> {
+    return config.datasetId(getDatasetNameView(context));
+}
+
 #endif  // GRPC_MOCK_SERVER_UTILS_H
@@ -0,0 +1,174 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "grpc_mock_server_wire_patch.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <bit>
+
+namespace grpc_mock_server {
+
+namespace {
+
+enum class WireType : uint32_t {
+    Varint = 0,
+    Fixed64 = 1,
+    LengthDelimited = 2,
+    Fixed32 = 5
+};
+
+void writeTag(google::protobuf::io::CodedOutputStream& output, int field_number, WireType wire_type) {
+    output.WriteTag((static_cast<uint32_t>(field_number) << 3) | static_cast<uint32_t>(wire_type));
+}
+
+// Same value conversions as MessageWrapper::setValue(); false if the value does not match the field type
+bool writeField(
+    google::protobuf::io::CodedOutputStream& output,
+    const google::protobuf::FieldDescriptor* field_descriptor,
+    const MessageWrapper::ValueView& value
+) {
+    const int field_number = field_descriptor->number();
+    switch (field_descriptor->type()) {
+    case google::protobuf::FieldDescriptor::TYPE_BOOL: {
+        if (!std::holds_alternative<bool>(value)) {
+            return false;
+        }
+        writeTag(output, field_number, WireType::Varint);
+        output.WriteVarint32(std::get<bool>(value) ? 1 : 0);
+        return true;
+    }
+    case google::protobuf::FieldDescriptor::TYPE_FLOAT: {
+        if (!std::holds_alternative<double>(value)) {
+            return false;
+        }
+        writeTag(output, field_number, WireType::Fixed32);
+        output.WriteLittleEndian32(std::bit_cast<uint32_t>(static_cast<float>(std::get<double>(value))));
+        return true;
+    }
+    case google::protobuf::FieldDescriptor::TYPE_DOUBLE: {
+        if (!std::holds_alternative<double>(value)) {
+            return false;
+        }
+        writeTag(output, field_number, WireType::Fixed64);
+        output.WriteLittleEndian64(std::bit_cast<uint64_t>(std::get<double>(value)));
+        return true;
+    }
+    case google::protobuf::FieldDescriptor::TYPE_ENUM: {
+        std::string_view value_string;
+        if (std::holds_alternative<MessageWrapper::EnumView>(value)) {
+            value_string = std::get<MessageWrapper::EnumView>(value).name;
+        }
+        else if (std::holds_alternative<std::string_view>(value)) {
+            value_string = std::get<std::string_view>(value);
+        }
+        else {
+            return false;
+        }
+
+        auto enum_value_descriptor = field_descriptor->enum_type()->FindValueByName(std::string(value_string));
+        if (enum_value_descriptor == nullptr) {
+            return false;
+        }
+        writeTag(output, field_number, WireType::Varint);
+        output.WriteVarint32SignExtended(enum_value_descriptor->number());
+        return true;
+    }
+    case google::protobuf::FieldDescriptor::TYPE_INT32: {
+        if (!std::holds_alternative<int64_t>(value)) {
+            return false;
+        }
+        writeTag(output, field_number, WireType::Varint);
+        output.WriteVarint32SignExtended(static_cast<int32_t>(std::get<int64_t>(value)));
+        return true;
+    }
+    case google::protobuf::FieldDescriptor::TYPE_INT64:
+    case google::protobuf::FieldDescriptor::TYPE_UINT64: {
+        if (!std::holds_alternative<int64_t>(value)) {
+            return false;
+        }
+        writeTag(output, field_number, WireType::Varint);
+        output.WriteVarint64(static_cast<uint64_t>(std::get<int64_t>(value)));
+        return true;
+    }
+    case google::protobuf::FieldDescriptor::TYPE_UINT32: {
+        if (!std::holds_alternative<int64_t>(value)) {
+            return false;
+        }
+        writeTag(output, field_number, WireType::Varint);
+        output.WriteVarint32(static_cast<uint32_t>(std::get<int64_t>(value)));
+        return true;
+    }
+    case google::protobuf::FieldDescriptor::TYPE_STRING: {
+        if (!std::holds_alternative<std::string_view>(value)) {
+            return false;
+        }
+        auto value_string = std::get<std::string_view>(value);
+        writeTag(output, field_number, WireType::LengthDelimited);
+        output.WriteVarint32(static_cast<uint32_t>(value_string.size()));
+        output.WriteRaw(value_string.data(), static_cast<int>(value_string.size()));
+        return true;
+    }
+    default: {
+        return false;
+    }
+    }
+}
+
+} // anonymous namespace
+
+auto encodeWirePatch(const CompiledOverrideProgram::BoundProgram& program) -> std::optional<std::string> {
+    std::string result;
+    std::string field_data;
+    for (const auto& request : program) {
+        if (request.field_descriptor->is_repeated()) {
+            return std::nullopt;
+        }
+
+        field_data.clear();
+        {
+            google::protobuf::io::StringOutputStream stream(&field_data);
+            google::protobuf::io::CodedOutputStream output(&stream);
+            if (!writeField(output, request.field_descriptor, *request.value)) {
+                return std::nullopt;
+            }
+        }
+
+        // Nested requests are wrapped into the singular message fields of the path, from the innermost one
+        for (auto it = request.path.rbegin(); it != request.path.rend(); ++it) {
+            if (it->is_repeated) {
+                return std::nullopt;
+            }
+
+            std::string wrapped_data;
+            {
+                google::protobuf::io::StringOutputStream stream(&wrapped_data);
+                google::protobuf::io::CodedOutputStream output(&stream);
+                writeTag(output, it->field_descriptor->number(), WireType::LengthDelimited);
+                output.WriteVarint32(static_cast<uint32_t>(field_data.size()));
+            }
+            wrapped_data += field_data;
+            field_data = std::move(wrapped_data);
+        }
+        result += field_data;
+    }
+    return result;
+}
+
+} // grpc_mock_server
@@ -0,0 +1,38 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef GRPC_MOCK_SERVER_WIRE_PATCH_H
+#define GRPC_MOCK_SERVER_WIRE_PATCH_H
+
+#include "grpc_mock_server_export.h"
+#include "grpc_mock_server_override_program.h"
+
+#include <optional>
+#include <string>
+
+namespace grpc_mock_server {
+
+// Encode the bound program as serialized fields to be appended to the wire bytes of the message.
+// Parser keeps the last value of a singular scalar field and merges singular message fields,
+// so base bytes followed by the patch decode to the same message as the one modified by CompiledOverrideProgram::apply().
+// nullopt if some request cannot be expressed that way: repeated fields on the path, array or null values
+GRPC_MOCK_SERVER_LIBRARY_API auto encodeWirePatch(const CompiledOverrideProgram::BoundProgram& program) -> std::optional<std::string>;
+
+} // grpc_mock_server
+
+#endif // GRPC_MOCK_SERVER_WIRE_PATCH_H
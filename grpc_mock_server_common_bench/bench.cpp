@@ -0,0 +1,314 @@
+﻿#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <grpc_mock_server_binary_mock.h>
+#include <grpc_mock_server_configuration.h>
+#include <grpc_mock_server_fs_utils.h>
+#include <grpc_mock_server_message_wrapper.h>
+#include <grpc_mock_server_override_program.h>
+#include <grpc_mock_server_request_language.h>
+#include <grpc_mock_server_trace_recorder.h>
+#include <grpc_mock_server_typed_fields.h>
+#include <grpc_mock_server_utils.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/wrappers.pb.h>
+#include "generated_code/test.pb.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+namespace {
+
+// Program of statement_count assignments cycling through all kinds of values
+std::string makeProgram(std::size_t statement_count) {
+    static const char* statements[] = {
+        "point_count := 12345\n",
+        "location.latitude := -409146138\n",
+        "name := \"Berkshire Valley Management Area Trail, Jefferson, NJ, USA\"\n",
+        "distance := 3.5\n",
+        "lo.enabled := true\n",
+        "kind := FEATURE_KIND_TRAIL\n",
+        "features[].location := null\n",
+    };
+
+    std::string result;
+    result.reserve(statement_count * 40);
+    for (std::size_t i = 0; i < statement_count; i++) {
+        result += statements[i % std::size(statements)];
+    }
+    return result;
+}
+
+// Config with method_count methods spread over datasets of 100 methods
+std::string makeConfig(std::size_t method_count) {
+    std::string result = "<root><remote_host_url name=\"localhost\" /><remote_host_port name=\"50051\" />";
+    for (std::size_t i = 0; i < method_count; i++) {
+        if (i % 100 == 0) {
+            result += (i == 0 ? "" : "</service></package></dataset>");
+            result += "<dataset name=\"dataset_" + std::to_string(i / 100) + "\"><package name=\"routeguide\"><service name=\"RouteGuide\">";
+        }
+        result += "<method name=\"Method" + std::to_string(i) + "\">"
+            "<full path=\"responses/method_" + std::to_string(i) + ".json\" />"
+            "<partial path=\"overrides/method_" + std::to_string(i) + ".txt\" /></method>";
+    }
+    result += "</service></package></dataset></root>";
+    return result;
+}
+
+// Plain wall-clock throughput, printed next to Catch2 statistics for easy comparison between builds
+template <typename Function>
+void reportThroughput(const std::string& name, std::size_t statement_count, Function&& function) {
+    using Clock = std::chrono::steady_clock;
+
+    std::size_t run_count = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    while (elapsed < std::chrono::seconds(1)) {
+        function();
+        run_count++;
+        elapsed = Clock::now() - start;
+    }
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    std::cout << name << ": " << static_cast<std::size_t>(run_count * statement_count / seconds) << " statements/s" << std::endl;
+}
+
+} // anonymous namespace
+
+TEST_CASE("RequestLanguage::parse", "[bench][message_wrapper]") {
+    constexpr std::size_t statement_count = 10000;
+
+    const auto& language = RequestLanguage::instance();
+    const auto program = makeProgram(statement_count);
+    REQUIRE(language.parseProgram(program)->statements.size() == statement_count);
+
+    BENCHMARK("parseProgram, 10k statements") {
+        return language.parseProgram(program);
+    };
+    BENCHMARK("parse to RequestWithValue, 10k statements") {
+        return language.parse(program);
+    };
+
+    reportThroughput("parseProgram", statement_count, [&] { return language.parseProgram(program); });
+}
+
+TEST_CASE("RequestLanguage backends", "[bench][message_wrapper]") {
+    using Backend = RequestLanguage::Backend;
+    constexpr std::size_t statement_count = 10000;
+
+    const auto& language = RequestLanguage::instance();
+    const auto program = makeProgram(statement_count);
+    REQUIRE((language.parse(program, Backend::Native) == language.parse(program, Backend::Peg)));
+
+    BENCHMARK("peglib backend, 10k statements") {
+        return language.parseProgram(program, Backend::Peg);
+    };
+    BENCHMARK("native backend, 10k statements") {
+        return language.parseProgram(program, Backend::Native);
+    };
+
+    reportThroughput("peglib backend", statement_count, [&] { return language.parseProgram(program, Backend::Peg); });
+    reportThroughput("native backend", statement_count, [&] { return language.parseProgram(program, Backend::Native); });
+}
+
+TEST_CASE("CompiledOverrideProgram::apply", "[bench][message_wrapper]") {
+    const auto& language = RequestLanguage::instance();
+    const std::string program_text =
+        "name := \"Berkshire Valley Management Area Trail, Jefferson, NJ, USA\"\n"
+        "location.latitude := 407838351\n"
+        "location.longitude := -746143763\n";
+
+    // Programs are bound once per message type, so the registry must be filled before the first apply()
+    auto& typed_fields = TypedFieldRegistry::instance();
+    typed_fields.clear();
+    auto reflection_program = MessageWrapper::compile(language, program_text);
+    REQUIRE(reflection_program->bind(routeguide::Feature::descriptor()) != nullptr);
+
+    typed_fields.add<&routeguide::Feature::mutable_name>(routeguide::Feature::kNameFieldNumber);
+    typed_fields.add<&routeguide::Feature::mutable_location>(routeguide::Feature::kLocationFieldNumber);
+    typed_fields.add<&routeguide::Point::set_latitude>(routeguide::Point::kLatitudeFieldNumber);
+    typed_fields.add<&routeguide::Point::set_longitude>(routeguide::Point::kLongitudeFieldNumber);
+    auto program = MessageWrapper::compile(language, program_text);
+    REQUIRE(program->bind(routeguide::Feature::descriptor())->front().setter != nullptr);
+
+    routeguide::Feature message;
+    BENCHMARK("Reflection, 3 statements") {
+        return reflection_program->apply(message);
+    };
+    BENCHMARK("TypedFieldRegistry, 3 statements") {
+        return program->apply(message);
+    };
+
+    reportThroughput("Reflection", 3, [&] { return reflection_program->apply(message); });
+    reportThroughput("TypedFieldRegistry", 3, [&] { return program->apply(message); });
+    typed_fields.clear();
+}
+
+TEST_CASE("TraceRecorder::record", "[bench][trace]") {
+    auto path = std::filesystem::temp_directory_path() / "gms_bench.gmstrace";
+    TraceRecorder recorder;
+    REQUIRE(recorder.open(path, 64 * 1024 * 1024));
+    auto method_id = recorder.registerMethod("/routeguide.RouteGuide/GetFeature").value();
+
+    routeguide::Point request;
+    request.set_latitude(409146138);
+    request.set_longitude(-746188906);
+    routeguide::Feature response;
+    response.set_name("Berkshire Valley Management Area Trail, Jefferson, NJ, USA");
+    *response.mutable_location() = request;
+    const auto request_data = request.SerializeAsString();
+    const auto response_data = response.SerializeAsString();
+
+    BENCHMARK("messages") {
+        return recorder.record(0, method_id, 0, request, response);
+    };
+    BENCHMARK("serialized bytes") {
+        return recorder.record(0, method_id, 0, request_data, response_data);
+    };
+
+    recorder.close();
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("MessageWrapper::parse and eval", "[bench][message_wrapper]") {
+    const auto& language = RequestLanguage::instance();
+    const std::string program =
+        "name := \"Berkshire Valley Management Area Trail, Jefferson, NJ, USA\"\n"
+        "location.latitude := 407838351\n"
+        "location.longitude := -746143763\n";
+    auto compiled_program = MessageWrapper::compile(language, program);
+    REQUIRE(compiled_program != nullptr);
+
+    routeguide::Feature message;
+    BENCHMARK("MessageWrapper::parse, 3 statements") {
+        return MessageWrapper::parse(language, program);
+    };
+    BENCHMARK("MessageWrapper::eval, program text, 3 statements") {
+        MessageWrapper::eval(message, language, program);
+    };
+    BENCHMARK("MessageWrapper::eval, compiled program, 3 statements") {
+        MessageWrapper::eval(message, *compiled_program);
+    };
+    BENCHMARK("evalRequest, 3 statements") {
+        evalRequest(message, program);
+    };
+}
+
+TEST_CASE("MessageWrapper::setValue and getValueString", "[bench][message_wrapper]") {
+    // Wrappers cover every scalar type with a single "value" field
+    auto benchmarkField = [](const std::string& type_name, google::protobuf::Message& message, const std::string& field_name, MessageWrapper::ValueView value) {
+        auto field_descriptor = message.GetDescriptor()->FindFieldByName(field_name);
+        auto reflection = message.GetReflection();
+        REQUIRE(field_descriptor != nullptr);
+
+        BENCHMARK("setValue, " + type_name) {
+            MessageWrapper::setValue(&message, field_descriptor, reflection, value);
+        };
+        BENCHMARK("getValueString, " + type_name) {
+            return MessageWrapper::getValueString(&message, field_descriptor, reflection);
+        };
+    };
+
+    google::protobuf::BoolValue bool_value;
+    google::protobuf::FloatValue float_value;
+    google::protobuf::DoubleValue double_value;
+    google::protobuf::Int32Value int32_value;
+    google::protobuf::Int64Value int64_value;
+    google::protobuf::UInt32Value uint32_value;
+    google::protobuf::UInt64Value uint64_value;
+    google::protobuf::StringValue string_value;
+    google::protobuf::FieldDescriptorProto enum_value;
+
+    benchmarkField("bool", bool_value, "value", true);
+    benchmarkField("float", float_value, "value", 3.5);
+    benchmarkField("double", double_value, "value", 3.5);
+    benchmarkField("int32", int32_value, "value", int64_t(-409146138));
+    benchmarkField("int64", int64_value, "value", int64_t(-409146138409146138));
+    benchmarkField("uint32", uint32_value, "value", int64_t(409146138));
+    benchmarkField("uint64", uint64_value, "value", int64_t(409146138409146138));
+    benchmarkField("string", string_value, "value", std::string_view("Berkshire Valley Management Area Trail, Jefferson, NJ, USA"));
+    benchmarkField("enum", enum_value, "type", MessageWrapper::EnumView("TYPE_STRING"));
+}
+
+TEST_CASE("message_as_json", "[bench][utils]") {
+    routeguide::Feature message;
+    message.set_name("Berkshire Valley Management Area Trail, Jefferson, NJ, USA");
+    message.mutable_location()->set_latitude(407838351);
+    message.mutable_location()->set_longitude(-746143763);
+    routeguide::Feature empty_message;
+
+    BENCHMARK("message_as_json, Feature") {
+        return message_as_json(message);
+    };
+    BENCHMARK("message_as_json, empty message") {
+        return message_as_json(empty_message);
+    };
+}
+
+TEST_CASE("Config::parse", "[bench][config]") {
+    auto& config = Config::instance();
+    for (std::size_t method_count : { std::size_t(1), std::size_t(100), std::size_t(10000) }) {
+        const auto data = makeConfig(method_count);
+        REQUIRE(config.parse(data));
+        REQUIRE(config.snapshot()->mockPaths().size() == method_count * 2);
+
+        BENCHMARK("Config::parse, " + std::to_string(method_count) + " methods") {
+            return config.parse(data);
+        };
+    }
+}
+
+TEST_CASE("readFile and MappedFile", "[bench][fs_utils]") {
+    auto path = (std::filesystem::temp_directory_path() / "gms_bench_large_file.json").string();
+    {
+        std::ofstream file(path, std::ios::trunc | std::ios::binary);
+        std::string line(1023, 'x');
+        line += '\n';
+        for (int i = 0; i < 64 * 1024; i++) {
+            file << line;
+        }
+    }
+
+    // Both read every byte, so the page faults of the mapping are measured too
+    BENCHMARK("readFile, 64 MiB") {
+        auto data = grpc_mock_server::readFile(path);
+        return std::accumulate(data.begin(), data.end(), std::size_t(0));
+    };
+    BENCHMARK("MappedFile::open, 64 MiB") {
+        auto file = MappedFile::open(path);
+        auto data = file->view();
+        return std::accumulate(data.begin(), data.end(), std::size_t(0));
+    };
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("loadResponse", "[bench][response]") {
+    routeguide::Feature feature;
+    feature.set_name("Berkshire Valley Management Area Trail, Jefferson, NJ, USA");
+    feature.mutable_location()->set_latitude(409146138);
+    feature.mutable_location()->set_longitude(-746188906);
+
+    auto json_path = (std::filesystem::temp_directory_path() / "gms_bench_response.json").string();
+    auto binary_path = (std::filesystem::temp_directory_path() / "gms_bench_response.binpb").string();
+    {
+        std::ofstream json_file(json_path, std::ios::trunc);
+        json_file << message_as_json(feature);
+        std::ofstream binary_file(binary_path, std::ios::trunc | std::ios::binary);
+        REQUIRE(grpc_mock_server::writeBinaryMock(binary_file, { &feature }));
+    }
+
+    const auto& prototype = routeguide::Feature::default_instance();
+    BENCHMARK("loadResponse, JSON") {
+        return grpc_mock_server::loadResponse(prototype, json_path, nullptr);
+    };
+    BENCHMARK("loadResponse, binary") {
+        return grpc_mock_server::loadResponse(prototype, binary_path, nullptr);
+    };
+
+    std::filesystem::remove(json_path);
+    std::filesystem::remove(binary_path);
+}
@@ -1,12 +1,32 @@
 ﻿#include <catch2/catch_test_macros.hpp>
+#include <grpc_mock_server_binary_mock.h>
 
 #include <grpc_mock_server_utils.h>
 #include <grpc_mock_server_fs_utils.h>
 #include <grpc_mock_server_configuration.h>
+#include <grpc_mock_server_call_log.h>
+#include <grpc_mock_server_config_watcher.h>
+#include <grpc_mock_server_generic_service.h>
+#include <grpc_mock_server_metrics.h>
+#include <grpc_mock_server_record_replay.h>
+#include <grpc_mock_server_trace_recorder.h>
+#include <grpc_mock_server_typed_fields.h>
 #include <google/protobuf/message.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/util/message_differencer.h>
 #include <grpcpp/impl/codegen/metadata_map.h>
 #include <grpc/impl/codegen/gpr_types.h>
 #include "generated_code/test.pb.h"
+#include "generated_code/test.grpc.pb.h"
+
+#ifndef WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // WIN32
 
 TEST_CASE("ToString", "[utils]") {
     SECTION("null") {
@@ -178,6 +198,16 @@ TEST_CASE("getDatasetName", "[utils]") {
     context.client_metadata();
     auto test = getDatasetName(&context);
     REQUIRE(getDatasetName(&context) == "fixed_price_1234.");
+    REQUIRE(getDatasetNameView(&context) == "fixed_price_1234");
+
+    REQUIRE(Config::instance().parse(
+        "<root><dataset name=\"fixed_price_1234\"><package name=\"p\"><service name=\"s\">"
+        "<method name=\"m\"><full path=\"full.json\" /></method>"
+        "</service></package></dataset></root>"
+    ));
+    auto config = Config::instance().snapshot();
+    REQUIRE(getDatasetId(*config, &context) == config->datasetId("fixed_price_1234"));
+    REQUIRE(getDatasetId(*config, &context).has_value());
 
     delete[] metadata.metadata;
     grpc_metadata_array_destroy(&metadata);
@@ -194,6 +224,64 @@ TEST_CASE("readFile", "[fs_utils]") {
 #endif
 }
 
+TEST_CASE("readBinaryFile", "[fs_utils]") {
+    auto path = (std::filesystem::temp_directory_path() / "gms_binary_file.bin").string();
+    const std::string data("line\r\n\x1a\0end", 11);
+    {
+        std::ofstream file(path, std::ios::trunc | std::ios::binary);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    REQUIRE(grpc_mock_server::readBinaryFile(path) == data);
+
+    std::filesystem::remove(path);
+    REQUIRE_THROWS_AS(grpc_mock_server::readBinaryFile(path), std::ios_base::failure);
+}
+
+TEST_CASE("MappedFile", "[fs_utils]") {
+    auto path = (std::filesystem::temp_directory_path() / "gms_mapped_file.bin").string();
+    routeguide::Feature feature;
+    feature.set_name("Berkshire Valley");
+    feature.mutable_location()->set_latitude(407838351);
+    {
+        std::ofstream file(path, std::ios::trunc | std::ios::binary);
+        REQUIRE(feature.SerializeToOstream(&file));
+    }
+
+    SECTION("view and protobuf stream") {
+        auto file = MappedFile::open(path);
+        REQUIRE(file.has_value());
+        REQUIRE(file->view() == feature.SerializeAsString());
+        REQUIRE(file->bytes().size() == file->size());
+
+        auto stream = file->inputStream();
+        routeguide::Feature parsed;
+        REQUIRE(parsed.ParseFromZeroCopyStream(&stream));
+        REQUIRE(google::protobuf::util::MessageDifferencer::Equals(parsed, feature));
+    }
+    SECTION("move keeps the mapping") {
+        auto file = MappedFile::open(path, MappedFile::Access::random);
+        REQUIRE(file.has_value());
+        auto data = file->view();
+        MappedFile moved = std::move(file.value());
+        REQUIRE(file->empty());
+        REQUIRE(moved.view().data() == data.data());
+        REQUIRE(moved.view() == feature.SerializeAsString());
+    }
+    SECTION("empty and missing files") {
+        std::ofstream(path, std::ios::trunc);
+        auto file = MappedFile::open(path);
+        REQUIRE(file.has_value());
+        REQUIRE(file->empty());
+        REQUIRE(file->view().empty());
+
+        std::filesystem::remove(path);
+        REQUIRE_FALSE(MappedFile::open(path).has_value());
+        REQUIRE_FALSE(MappedFile::open(std::filesystem::temp_directory_path()).has_value());
+    }
+
+    std::filesystem::remove(path);
+}
+
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 TEST_CASE("Config", "[config]") {
@@ -219,6 +307,139 @@ TEST_CASE("Config", "[config]") {
         REQUIRE(config.fullPath("fixed_price_1234.orderPackage.orderService/ListOrders") == "list_orders_response.txt");
         REQUIRE(config.partialPath("fixed_price_1234.orderPackage.orderService/ListOrders") == "list_orders_request.txt");
     }
+    SECTION("findMethod") {
+        auto& config = Config::instance();
+        REQUIRE(config.parse(
+            "<root><dataset name=\"lookup\"><package name=\"p\"><service name=\"s\">"
+            "<method name=\"full\"><full path=\"full.json\" /></method>"
+            "<!-- comment -->"
+            "<method name=\"partial\"><partial path=\"partial.txt\" /></method>"
+            "</service></package></dataset></root>"
+        ));
+        auto snapshot = config.snapshot();
+
+        auto method = snapshot->findMethod("lookup", "/p.s/full");
+        REQUIRE(method != nullptr);
+        REQUIRE(method->m_method_name == "lookup.p.s/full");
+        REQUIRE(method->m_full_path == "full.json");
+        REQUIRE(method->m_partial_path.empty());
+        REQUIRE(snapshot->findMethod("lookup", "p.s/full") == method);
+        REQUIRE(snapshot->findMethod("lookup.p.s/full") == method);
+
+        // Paths of the previous method are not inherited
+        method = snapshot->findMethod("lookup.p.s/partial");
+        REQUIRE(method != nullptr);
+        REQUIRE(method->m_full_path.empty());
+        REQUIRE(method->m_partial_path == "partial.txt");
+
+        REQUIRE(snapshot->findMethod("lookup", "/p.s/missing") == nullptr);
+        REQUIRE(snapshot->findMethod("other", "/p.s/full") == nullptr);
+        REQUIRE(snapshot->findMethod("lookup") == nullptr);
+        REQUIRE(snapshot->mockPaths().size() == 2);
+    }
+    SECTION("findMethod dotted dataset") {
+        auto& config = Config::instance();
+        REQUIRE(config.parse(
+            "<root><dataset name=\"v1.2\"><package name=\"a.b\"><service name=\"s\">"
+            "<method name=\"m\"><full path=\"m.json\" /></method>"
+            "</service></package></dataset></root>"
+        ));
+        auto snapshot = config.snapshot();
+
+        auto method = snapshot->findMethod("v1.2.a.b.s/m");
+        REQUIRE(method != nullptr);
+        REQUIRE(method == snapshot->findMethod("v1.2", "/a.b.s/m"));
+        REQUIRE(method->m_full_path == "m.json");
+        REQUIRE(snapshot->findMethod("v1.2.a.b.s/missing") == nullptr);
+    }
+    SECTION("interned ids") {
+        auto& config = Config::instance();
+        REQUIRE(config.parse(
+            "<root>"
+            "<dataset name=\"first\"><package name=\"p\"><service name=\"s\">"
+            "<method name=\"a\"><full path=\"first_a.json\" /></method>"
+            "</service></package></dataset>"
+            "<dataset name=\"second\"><package name=\"p\"><service name=\"s\">"
+            "<method name=\"b\"><full path=\"second_b.json\" /></method>"
+            "<method name=\"a\"><full path=\"second_a.json\" /></method>"
+            "</service></package></dataset>"
+            "</root>"
+        ));
+        auto snapshot = config.snapshot();
+
+        auto first = snapshot->datasetId("first");
+        auto second = snapshot->datasetId("second");
+        auto method_a = snapshot->methodId("/p.s/a");
+        auto method_b = snapshot->methodId("p.s/b");
+        REQUIRE(first.has_value());
+        REQUIRE(second.has_value());
+        REQUIRE(first != second);
+        REQUIRE(method_a.has_value());
+        REQUIRE(method_b.has_value());
+        REQUIRE(method_a != method_b);
+        REQUIRE_FALSE(snapshot->datasetId("third").has_value());
+        REQUIRE_FALSE(snapshot->methodId("/p.s/c").has_value());
+
+        REQUIRE(snapshot->findMethod(first.value(), method_a.value())->m_full_path == "first_a.json");
+        REQUIRE(snapshot->findMethod(second.value(), method_a.value())->m_full_path == "second_a.json");
+        REQUIRE(snapshot->findMethod(second.value(), method_b.value())->m_method_name == "second.p.s/b");
+        REQUIRE(snapshot->findMethod(first.value(), method_b.value()) == nullptr);
+        REQUIRE(snapshot->findMethod(first.value(), 1000) == nullptr);
+        REQUIRE(snapshot->findMethod(1000, method_a.value()) == nullptr);
+    }
+    SECTION("snapshots are immutable") {
+        auto& config = Config::instance();
+        REQUIRE(config.parse(
+            "<root><dataset name=\"snapshot\"><package name=\"p\"><service name=\"s\">"
+            "<method name=\"m\"><full path=\"first.json\" /></method>"
+            "</service></package></dataset></root>"
+        ));
+        auto first_snapshot = config.snapshot();
+        REQUIRE(first_snapshot->fullPath("snapshot.p.s/m") == "first.json");
+
+        REQUIRE(config.parse(
+            "<root><dataset name=\"snapshot\"><package name=\"p\"><service name=\"s\">"
+            "<method name=\"m\"><full path=\"second.json\" /></method>"
+            "</service></package></dataset></root>"
+        ));
+        REQUIRE(config.fullPath("snapshot.p.s/m") == "second.json");
+        REQUIRE(config.snapshot() != first_snapshot);
+        REQUIRE(first_snapshot->fullPath("snapshot.p.s/m") == "first.json");
+
+        // Invalid data keeps the current snapshot
+        REQUIRE_FALSE(config.parse("<root>"));
+        REQUIRE(config.fullPath("snapshot.p.s/m") == "second.json");
+    }
+}
+
+TEST_CASE("ConfigWatcher", "[config]") {
+    auto config_path = std::filesystem::temp_directory_path() / "gms_config_watcher_test.xml";
+    auto writeConfig = [&config_path](const std::string& full_path) {
+        std::ofstream config_file(config_path, std::ios::trunc);
+        config_file
+            << "<root><dataset name=\"watcher\"><package name=\"p\"><service name=\"s\">"
+            << "<method name=\"m\"><full path=\"" << full_path << "\" /></method>"
+            << "</service></package></dataset></root>";
+    };
+    writeConfig("first.json");
+
+    ConfigWatcher watcher(config_path, std::chrono::milliseconds(20));
+    REQUIRE(watcher.start());
+    REQUIRE(watcher.isRunning());
+    REQUIRE(Config::instance().fullPath("watcher.p.s/m") == "first.json");
+
+    writeConfig("second.json");
+    // Polling fallback needs the modification time to differ
+    std::filesystem::last_write_time(config_path, std::filesystem::last_write_time(config_path) + std::chrono::seconds(1));
+    for (int i = 0; i < 200 && watcher.reloadCount() == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(watcher.reloadCount() > 0);
+    REQUIRE(Config::instance().fullPath("watcher.p.s/m") == "second.json");
+
+    watcher.stop();
+    REQUIRE_FALSE(watcher.isRunning());
+    std::filesystem::remove(config_path);
 }
 
 // --------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -233,6 +454,139 @@ TEST_CASE("message_as_json", "[utils]") {
     REQUIRE(message_json == R"({"pointCount":5,"featureCount":4,"distance":3,"elapsedTime":1})");
 }
 
+TEST_CASE("CallLog", "[logger]") {
+    routeguide::RouteSummary request;
+    request.set_point_count(5);
+
+    SECTION("JSON is rendered on the logging thread") {
+        std::vector<std::string> calls;
+        std::thread::id callback_thread_id;
+        {
+            CallLog call_log([&](time_t time, const std::string& method, const std::string& request_json, int status, const std::string& response_json) {
+                callback_thread_id = std::this_thread::get_id();
+                calls.push_back(std::to_string(time) + " " + method + " " + request_json + " " + std::to_string(status) + " " + response_json);
+            });
+            call_log.push(1, "/routeguide.RouteGuide/RecordRoute", LazyMessageJson::copyMessage(request), 0, nullptr);
+            request.set_point_count(6);
+            call_log.flush();
+            REQUIRE(calls.size() == 1);
+            REQUIRE(calls[0] == R"(1 /routeguide.RouteGuide/RecordRoute {"pointCount":5} 0 )");
+            REQUIRE(callback_thread_id != std::this_thread::get_id());
+
+            // Queued calls are passed to the callback on destruction
+            call_log.push(2, "/routeguide.RouteGuide/GetFeature", nullptr, 12, nullptr);
+        }
+        REQUIRE(calls.size() == 2);
+    }
+    SECTION("bounded queue") {
+        std::size_t call_count = 0;
+        CallLog call_log(CallLog::kTraceCallback, [&](const auto&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            call_count++;
+        }, 2, spdlog::async_overflow_policy::overrun_oldest);
+        for (int i = 0; i < 10; i++) {
+            call_log.push(i, "/routeguide.RouteGuide/GetFeature", nullptr, 0, nullptr);
+        }
+        call_log.flush();
+        REQUIRE(call_count + call_log.droppedCount() == 10);
+        REQUIRE(call_count >= 2);
+    }
+    SECTION("JSON is not rendered for the filtered out calls") {
+        std::vector<std::string> calls;
+        {
+            CallLog call_log(CallLog::kTraceCallback, [&](const auto& trace) {
+                if (trace.m_status != 0) {
+                    calls.push_back(trace.m_request.json());
+                }
+            });
+            call_log.push(CallTrace(1, "/routeguide.RouteGuide/RecordRoute", LazyMessageJson(LazyMessageJson::copyMessage(request)), 0, LazyMessageJson()));
+            call_log.push(CallTrace(2, "/routeguide.RouteGuide/RecordRoute", LazyMessageJson(request, request.SerializeAsString()), 2, LazyMessageJson()));
+        }
+        REQUIRE(calls.size() == 1);
+        REQUIRE(calls[0] == R"({"pointCount":5})");
+    }
+}
+
+TEST_CASE("LazyMessageJson", "[logger]") {
+    routeguide::RouteSummary message;
+    REQUIRE(LazyMessageJson().empty());
+    REQUIRE(LazyMessageJson().json().empty());
+    REQUIRE(LazyMessageJson(LazyMessageJson::copyMessage(message)).empty());
+    REQUIRE(LazyMessageJson(LazyMessageJson::copyMessage(message)).json().empty());
+
+    message.set_distance(3);
+    LazyMessageJson from_message(LazyMessageJson::copyMessage(message));
+    REQUIRE_FALSE(from_message.empty());
+    REQUIRE(from_message.json() == R"({"distance":3})");
+    REQUIRE(&from_message.json() == &from_message.json());
+
+    LazyMessageJson from_wire(routeguide::RouteSummary::default_instance(), message.SerializeAsString());
+    REQUIRE_FALSE(from_wire.empty());
+    REQUIRE(from_wire.json() == R"({"distance":3})");
+}
+
+TEST_CASE("TraceRecorder", "[logger]") {
+    auto path = std::filesystem::temp_directory_path() / "gms_trace_recorder.gmstrace";
+    auto decode = [&] {
+        std::ostringstream output;
+        REQUIRE(grpc_mock_server::decodeTrace(
+            path,
+            *google::protobuf::DescriptorPool::generated_pool(),
+            *google::protobuf::MessageFactory::generated_factory(),
+            output
+        ));
+        return output.str();
+    };
+
+    routeguide::Point request;
+    request.set_latitude(5);
+    routeguide::Feature response;
+    response.set_name("Berkshire Valley");
+
+    TraceRecorder recorder;
+    SECTION("records are decoded with the descriptor pool") {
+        REQUIRE(recorder.open(path, 4096));
+        auto method_id = recorder.registerMethod("/routeguide.RouteGuide/GetFeature");
+        REQUIRE(method_id.has_value());
+        REQUIRE(recorder.registerMethod("/routeguide.RouteGuide/GetFeature") == method_id);
+
+        REQUIRE(recorder.record(1, method_id.value(), 0, request, response));
+        REQUIRE(recorder.record(2, method_id.value(), 5, request.SerializeAsString(), std::string()));
+        REQUIRE(decode() ==
+            "{\"time\":1,\"method\":\"/routeguide.RouteGuide/GetFeature\",\"status\":0,\"request\":{\"latitude\":5},\"response\":{\"name\":\"Berkshire Valley\"}}\n"
+            "{\"time\":2,\"method\":\"/routeguide.RouteGuide/GetFeature\",\"status\":5,\"request\":{\"latitude\":5},\"response\":{}}\n"
+        );
+    }
+    SECTION("oldest records are overwritten") {
+        REQUIRE(recorder.open(path, 256));
+        auto method_id = recorder.registerMethod("/routeguide.RouteGuide/GetFeature").value();
+        for (int i = 0; i < 100; i++) {
+            request.set_latitude(i);
+            REQUIRE(recorder.record(i, method_id, 0, request, response));
+        }
+        REQUIRE(recorder.writeOffset() > 256);
+
+        auto lines = decode();
+        REQUIRE(lines.ends_with("\"request\":{\"latitude\":99},\"response\":{\"name\":\"Berkshire Valley\"}}\n"));
+        REQUIRE(lines.find("\"latitude\":90}") == std::string::npos);
+    }
+    SECTION("method names are escaped") {
+        REQUIRE(recorder.open(path, 4096));
+        auto method_id = recorder.registerMethod("/routeguide.\"Route\\Guide\"/GetFeature").value();
+        REQUIRE(recorder.record(1, method_id, 0, std::string(), std::string()));
+        REQUIRE(decode() ==
+            "{\"time\":1,\"method\":\"/routeguide.\\\"Route\\\\Guide\\\"/GetFeature\",\"status\":0,\"request\":null,\"response\":null}\n"
+        );
+    }
+    SECTION("records larger than the ring are rejected") {
+        REQUIRE(recorder.open(path, 64));
+        REQUIRE_FALSE(recorder.record(0, 0, 0, std::string(64, 'x'), std::string()));
+    }
+
+    recorder.close();
+    std::filesystem::remove(path);
+}
+
 TEST_CASE("evalRequest", "[utils]") {
     routeguide::RouteSummary message;
     message.set_point_count(5);
@@ -248,3 +602,1071 @@ TEST_CASE("evalRequest", "[utils]") {
 
     REQUIRE(message.point_count() == 12345);
 }
+
+TEST_CASE("RequestLanguage", "[message_wrapper]") {
+    const auto& language = RequestLanguage::instance();
+    REQUIRE(language.isValid());
+    REQUIRE(&language == &RequestLanguage::instance());
+
+    auto rc_fs = cmrc::grpc_mock_server::get_filesystem();
+    auto request_file = rc_fs.open("assets/point_count_request.txt");
+    auto request_data = std::string(request_file.cbegin(), request_file.cend());
+
+    SECTION("parse") {
+        auto requests = MessageWrapper::parse(language, request_data);
+        REQUIRE(requests.has_value());
+        REQUIRE(requests->size() == 1);
+        REQUIRE(requests->front().first == std::vector<std::string>{ "point_count" });
+        REQUIRE(std::get<int64_t>(requests->front().second) == 12345);
+    }
+    SECTION("eval with the shared language instance") {
+        for (int i = 0; i < 3; i++) {
+            routeguide::RouteSummary message;
+            message.set_point_count(i);
+            MessageWrapper::eval(message, language, request_data);
+            REQUIRE(message.point_count() == 12345);
+        }
+    }
+}
+
+TEST_CASE("OverrideProgramCache", "[message_wrapper]") {
+    auto request_path = (std::filesystem::temp_directory_path() / "gms_override_program_cache_test.txt").string();
+    {
+        std::ofstream request_file(request_path, std::ios::trunc);
+        request_file << "point_count := 12345\n";
+    }
+
+    OverrideProgramCache cache(RequestLanguage::instance(), grpc_mock_server::CacheInvalidation::write_time);
+    const std::string method_name = "fixed_price_1234.routeguide.RouteGuide/RecordRoute";
+
+    auto program = cache.get(method_name, request_path);
+    REQUIRE(program != nullptr);
+    REQUIRE(program->program().statements.size() == 1);
+    REQUIRE(cache.get(method_name, request_path) == program);
+    REQUIRE(cache.size() == 1);
+
+    SECTION("compiled program is applied to any number of messages") {
+        for (int i = 0; i < 3; i++) {
+            routeguide::RouteSummary message;
+            MessageWrapper::eval(message, *program);
+            REQUIRE(message.point_count() == 12345);
+        }
+    }
+    SECTION("modified file is recompiled") {
+        {
+            std::ofstream request_file(request_path, std::ios::trunc);
+            request_file << "point_count := 54321\n";
+        }
+        std::filesystem::last_write_time(request_path, std::filesystem::last_write_time(request_path) + std::chrono::seconds(1));
+
+        auto modified_program = cache.get(method_name, request_path);
+        REQUIRE(modified_program != nullptr);
+        REQUIRE(modified_program != program);
+
+        routeguide::RouteSummary message;
+        MessageWrapper::eval(message, *modified_program);
+        REQUIRE(message.point_count() == 54321);
+    }
+    SECTION("modified file is recompiled after clear() only by default") {
+        OverrideProgramCache clear_cache(RequestLanguage::instance());
+        auto cached_program = clear_cache.get(method_name, request_path);
+        REQUIRE(cached_program != nullptr);
+        {
+            std::ofstream request_file(request_path, std::ios::trunc);
+            request_file << "point_count := 54321\n";
+        }
+        std::filesystem::last_write_time(request_path, std::filesystem::last_write_time(request_path) + std::chrono::seconds(1));
+        REQUIRE(clear_cache.get(method_name, request_path) == cached_program);
+
+        clear_cache.clear();
+        auto modified_program = clear_cache.get(method_name, request_path);
+        REQUIRE(modified_program != nullptr);
+        REQUIRE(modified_program != cached_program);
+    }
+    SECTION("missing file") {
+        REQUIRE(cache.get(method_name, request_path + ".missing") == nullptr);
+    }
+#ifndef WIN32
+    SECTION("file read before clear() is not cached") {
+        auto fifo_path = (std::filesystem::temp_directory_path() / "gms_override_program_cache_fifo.txt").string();
+        std::filesystem::remove(fifo_path);
+        REQUIRE(mkfifo(fifo_path.c_str(), 0600) == 0);
+
+        OverrideProgramCache clear_cache(RequestLanguage::instance());
+        std::shared_ptr<const CompiledOverrideProgram> loaded;
+        std::thread loader([&] { loaded = clear_cache.get(method_name, fifo_path); });
+        {
+            // Opening the writing end waits until the loader opens the file
+            std::ofstream fifo(fifo_path);
+            clear_cache.clear();
+            fifo << "point_count := 7\n";
+        }
+        loader.join();
+        REQUIRE(loaded != nullptr);
+        REQUIRE(clear_cache.size() == 0);
+
+        std::filesystem::remove(fifo_path);
+    }
+#endif // WIN32
+
+    std::filesystem::remove(request_path);
+}
+
+TEST_CASE("CompiledOverrideProgram::bind", "[message_wrapper]") {
+    auto program = MessageWrapper::compile(RequestLanguage::instance(), "lo.latitude := 7\nhi.longitude := 9\n");
+    REQUIRE(program != nullptr);
+
+    routeguide::Rectangle message;
+    const auto* bound_program = program->bind(message.GetDescriptor());
+    REQUIRE(bound_program != nullptr);
+    REQUIRE(bound_program == program->bind(routeguide::Rectangle::descriptor()));
+    REQUIRE(bound_program->size() == 2);
+    REQUIRE(bound_program->at(0).path.size() == 1);
+    REQUIRE(bound_program->at(0).path.front().field_descriptor == routeguide::Rectangle::descriptor()->FindFieldByName("lo"));
+    REQUIRE(bound_program->at(0).field_descriptor == routeguide::Point::descriptor()->FindFieldByName("latitude"));
+
+    REQUIRE(program->apply(message));
+    REQUIRE(message.lo().latitude() == 7);
+    REQUIRE(message.hi().longitude() == 9);
+
+    SECTION("path not matching the message type") {
+        routeguide::Point point;
+        REQUIRE(program->bind(point.GetDescriptor()) == nullptr);
+        REQUIRE_FALSE(program->apply(point));
+    }
+}
+
+TEST_CASE("RequestLanguage::parseProgram", "[message_wrapper]") {
+    const auto& language = RequestLanguage::instance();
+    auto program = language.parseProgram(
+        "# comment\n"
+        "lo.latitude := 7\n"
+        "features[].name := \"test\"\n"
+        "distance := 3.5\n"
+        "enabled := true\n"
+        "kind := KIND_TRAIL\n"
+        "location := null\n"
+    );
+    REQUIRE(program.has_value());
+    REQUIRE(program->statements.size() == 6);
+    REQUIRE(program->path_tokens.size() == 8);
+
+    const auto& statements = program->statements;
+    auto first_path = program->path(statements[0]);
+    REQUIRE(std::vector<std::string>(first_path.begin(), first_path.end()) == std::vector<std::string>{ "lo", "latitude" });
+    auto second_path = program->path(statements[1]);
+    REQUIRE(std::vector<std::string>(second_path.begin(), second_path.end()) == std::vector<std::string>{ "features[]", "name" });
+
+    REQUIRE(std::get<int64_t>(statements[0].value) == 7);
+    REQUIRE(std::get<std::string_view>(statements[1].value) == "test");
+    REQUIRE(std::get<double>(statements[2].value) == 3.5);
+    REQUIRE(std::get<bool>(statements[3].value) == true);
+    REQUIRE(std::get<MessageWrapper::EnumView>(statements[4].value).name == "KIND_TRAIL");
+    REQUIRE(std::holds_alternative<std::nullptr_t>(statements[5].value));
+
+    REQUIRE_FALSE(language.parseProgram("lo.latitude = 7\n").has_value());
+
+    SECTION("tokens and string values are views into the program text owned by the program") {
+        const auto& source = *program->source;
+        auto points_into_source = [&source](std::string_view view) {
+            return view.data() >= source.data() && view.data() + view.size() <= source.data() + source.size();
+        };
+        for (const auto& path_token : program->path_tokens) {
+            REQUIRE(points_into_source(path_token));
+        }
+        REQUIRE(points_into_source(std::get<std::string_view>(statements[1].value)));
+        REQUIRE(points_into_source(std::get<MessageWrapper::EnumView>(statements[4].value).name));
+
+        auto program_copy = program.value();
+        program.reset();
+        REQUIRE(program_copy.path(program_copy.statements[1])[0] == "features[]");
+    }
+}
+
+TEST_CASE("array values", "[message_wrapper]") {
+    const auto& language = RequestLanguage::instance();
+
+    SECTION("parse") {
+        auto requests = language.parse("values[] := [1,2.5,\"s\",KIND_TRAIL]\n");
+        REQUIRE(requests.has_value());
+        auto expected = MessageWrapper::ArrayWrapper{ { int64_t(1), 2.5, std::string("s"), MessageWrapper::EnumWrapper("KIND_TRAIL") } };
+        REQUIRE((std::get<MessageWrapper::ArrayWrapper>(requests->front().second) == expected));
+    }
+    SECTION("array replaces the content of the repeated field") {
+        google::protobuf::FileDescriptorProto message;
+        message.add_dependency("a.proto");
+        auto program = MessageWrapper::compile(language, "dependency[] := [\"b.proto\",\"c.proto\",\"d.proto\"]\n");
+        REQUIRE(program != nullptr);
+        REQUIRE(program->apply(message));
+        REQUIRE(message.dependency_size() == 3);
+        REQUIRE(message.dependency(0) == "b.proto");
+        REQUIRE(message.dependency(2) == "d.proto");
+    }
+    SECTION("array is assigned to every element of the repeated parent") {
+        google::protobuf::SourceCodeInfo message;
+        message.add_location()->add_path(9);
+        message.add_location();
+        auto program = MessageWrapper::compile(language, "location[].path[] := [1,2,-3]\n");
+        REQUIRE(program != nullptr);
+        REQUIRE(program->apply(message));
+        for (const auto& location : message.location()) {
+            REQUIRE(std::vector<int32_t>(location.path().begin(), location.path().end()) == std::vector<int32_t>{ 1, 2, -3 });
+        }
+    }
+    SECTION("enum, unsigned and message arrays") {
+        google::protobuf::FileDescriptorProto file;
+        file.set_name("gms_array_values.proto");
+        file.set_package("gms");
+        file.set_syntax("proto3");
+        auto* enum_type = file.add_enum_type();
+        enum_type->set_name("Kind");
+        enum_type->add_value()->set_name("KIND_NONE");
+        enum_type->add_value()->set_name("KIND_TRAIL");
+        enum_type->mutable_value(1)->set_number(1);
+        auto* message_type = file.add_message_type();
+        message_type->set_name("Arrays");
+        auto add_field = [message_type](const std::string& name, google::protobuf::FieldDescriptorProto::Type type, const std::string& type_name) {
+            auto* field = message_type->add_field();
+            field->set_name(name);
+            field->set_number(message_type->field_size());
+            field->set_label(google::protobuf::FieldDescriptorProto::LABEL_REPEATED);
+            field->set_type(type);
+            if (!type_name.empty()) {
+                field->set_type_name(type_name);
+            }
+        };
+        add_field("kinds", google::protobuf::FieldDescriptorProto::TYPE_ENUM, ".gms.Kind");
+        add_field("counts", google::protobuf::FieldDescriptorProto::TYPE_UINT64, "");
+        add_field("children", google::protobuf::FieldDescriptorProto::TYPE_MESSAGE, ".gms.Arrays");
+
+        google::protobuf::DescriptorPool pool;
+        REQUIRE(pool.BuildFile(file) != nullptr);
+        google::protobuf::DynamicMessageFactory factory(&pool);
+        std::unique_ptr<google::protobuf::Message> message(factory.GetPrototype(pool.FindMessageTypeByName("gms.Arrays"))->New());
+        const auto* descriptor = message->GetDescriptor();
+        const auto* reflection = message->GetReflection();
+
+        MessageWrapper::setValue(message.get(), descriptor->FindFieldByName("kinds"), reflection, MessageWrapper::ArrayWrapper{
+            { MessageWrapper::EnumWrapper("KIND_TRAIL"), MessageWrapper::EnumWrapper("KIND_NONE") }
+        });
+        REQUIRE(reflection->FieldSize(*message, descriptor->FindFieldByName("kinds")) == 2);
+        REQUIRE(reflection->GetRepeatedEnumValue(*message, descriptor->FindFieldByName("kinds"), 0) == 1);
+
+        // Negative values leave the unsigned field unchanged
+        const auto* counts = descriptor->FindFieldByName("counts");
+        reflection->AddUInt64(message.get(), counts, 7);
+        MessageWrapper::setValue(message.get(), counts, reflection, MessageWrapper::ArrayWrapper{ { int64_t(1), int64_t(-2) } });
+        REQUIRE(reflection->FieldSize(*message, counts) == 1);
+        REQUIRE(reflection->GetRepeatedUInt64(*message, counts, 0) == 7);
+        MessageWrapper::setValue(message.get(), counts, reflection, MessageWrapper::ArrayWrapper{ { int64_t(1), int64_t(2) } });
+        REQUIRE(reflection->FieldSize(*message, counts) == 2);
+        REQUIRE(reflection->GetRepeatedUInt64(*message, counts, 1) == 2);
+
+        // Message arrays are not supported, the field is left unchanged
+        MessageWrapper::setValue(message.get(), descriptor->FindFieldByName("children"), reflection, MessageWrapper::ArrayWrapper{ { int64_t(1) } });
+        REQUIRE(reflection->FieldSize(*message, descriptor->FindFieldByName("children")) == 0);
+    }
+    SECTION("array views stay valid in program copies") {
+        auto program = language.parseProgram("a[] := [1,2]\nb[] := [3]\n");
+        REQUIRE(program.has_value());
+        auto program_copy = program.value();
+        program.reset();
+        auto items = std::get<MessageWrapper::ArrayView>(program_copy.statements[1].value).items;
+        REQUIRE(items.size() == 1);
+        REQUIRE(std::get<int64_t>(items[0]) == 3);
+    }
+}
+
+TEST_CASE("TypedFieldRegistry", "[message_wrapper]") {
+    const auto& language = RequestLanguage::instance();
+    auto& typed_fields = TypedFieldRegistry::instance();
+    typed_fields.clear();
+    typed_fields.add<&routeguide::RouteSummary::set_point_count>(routeguide::RouteSummary::kPointCountFieldNumber);
+    typed_fields.add<&routeguide::Feature::mutable_name>(routeguide::Feature::kNameFieldNumber);
+    typed_fields.add<&routeguide::Feature::mutable_location>(routeguide::Feature::kLocationFieldNumber);
+    typed_fields.add<&routeguide::Point::set_latitude>(routeguide::Point::kLatitudeFieldNumber);
+    REQUIRE(typed_fields.size() == 4);
+
+    SECTION("registered fields are bound to the generated accessors") {
+        auto program = MessageWrapper::compile(language, "name := \"typed\"\nlocation.latitude := 5\nlocation.longitude := 6\n");
+        REQUIRE(program != nullptr);
+        auto bound_program = program->bind(routeguide::Feature::descriptor());
+        REQUIRE(bound_program != nullptr);
+        REQUIRE(bound_program->at(0).setter != nullptr);
+        REQUIRE(bound_program->at(1).path[0].mutable_message != nullptr);
+        REQUIRE(bound_program->at(1).setter != nullptr);
+        // Not registered, set through Reflection
+        REQUIRE(bound_program->at(2).setter == nullptr);
+
+        routeguide::Feature message;
+        REQUIRE(program->apply(message));
+        REQUIRE(message.name() == "typed");
+        REQUIRE(message.location().latitude() == 5);
+        REQUIRE(message.location().longitude() == 6);
+    }
+    SECTION("scalar setter") {
+        routeguide::RouteSummary message;
+        auto program = MessageWrapper::compile(language, "point_count := 12345\n");
+        REQUIRE(program != nullptr);
+        REQUIRE(program->apply(message));
+        REQUIRE(message.point_count() == 12345);
+    }
+
+    typed_fields.clear();
+    REQUIRE(typed_fields.size() == 0);
+}
+
+TEST_CASE("buildResponse", "[response]") {
+    auto full_path = (std::filesystem::temp_directory_path() / "gms_build_response_full.json").string();
+    auto partial_path = (std::filesystem::temp_directory_path() / "gms_build_response_partial.txt").string();
+    {
+        std::ofstream full_file(full_path, std::ios::trunc);
+        full_file << R"({"name": "Berkshire Valley", "location": {"latitude": 407838351}})";
+        std::ofstream partial_file(partial_path, std::ios::trunc);
+        partial_file << "location.longitude := -746143763\n";
+    }
+    const auto& prototype = routeguide::Feature::default_instance();
+    const std::string method_name = "fixed_price_1234.routeguide.RouteGuide/GetFeature";
+
+    SECTION("response and its submessages live on the arena") {
+        google::protobuf::Arena arena;
+        auto response = grpc_mock_server::buildResponse(prototype, method_name, full_path, partial_path, &arena);
+        REQUIRE(response != nullptr);
+        REQUIRE(response->GetArena() == &arena);
+
+        const auto& feature = static_cast<const routeguide::Feature&>(*response);
+        REQUIRE(feature.name() == "Berkshire Valley");
+        REQUIRE(feature.location().GetArena() == &arena);
+        REQUIRE(feature.location().latitude() == 407838351);
+        REQUIRE(feature.location().longitude() == -746143763);
+    }
+    SECTION("heap response") {
+        auto response = grpc_mock_server::buildResponse(prototype, method_name, full_path, "", nullptr);
+        REQUIRE(response != nullptr);
+        REQUIRE(response->GetArena() == nullptr);
+        REQUIRE(static_cast<const routeguide::Feature&>(*response).location().longitude() == 0);
+    }
+    SECTION("thread arena is reused") {
+        auto& arena = grpc_mock_server::threadArena();
+        REQUIRE(&arena == &grpc_mock_server::threadArena());
+        REQUIRE(grpc_mock_server::loadResponse(prototype, full_path, &arena) != nullptr);
+        REQUIRE(arena.SpaceUsed() > 0);
+        arena.Reset();
+        REQUIRE(arena.SpaceUsed() == 0);
+    }
+    SECTION("missing response file") {
+        REQUIRE(grpc_mock_server::loadResponse(prototype, full_path + ".missing", nullptr) == nullptr);
+    }
+    SECTION("large response file is mapped") {
+        auto large_path = (std::filesystem::temp_directory_path() / "gms_large_response.json").string();
+        std::string name(grpc_mock_server::kMappedResponseMinSize, 'x');
+        {
+            std::ofstream large_file(large_path, std::ios::trunc);
+            large_file << R"({"name": ")" << name << R"("})";
+        }
+        auto response = grpc_mock_server::loadResponse(prototype, large_path, nullptr);
+        REQUIRE(response != nullptr);
+        REQUIRE(static_cast<const routeguide::Feature&>(*response).name() == name);
+
+        // Replacing the file by rename does not affect the parsed response
+        auto replacement_path = large_path + ".new";
+        {
+            std::ofstream replacement_file(replacement_path, std::ios::trunc);
+            replacement_file << R"({"name": ")" << name << R"(y"})";
+        }
+        std::filesystem::rename(replacement_path, large_path);
+        REQUIRE(static_cast<const routeguide::Feature&>(*response).name() == name);
+        response = grpc_mock_server::loadResponse(prototype, large_path, nullptr);
+        REQUIRE(static_cast<const routeguide::Feature&>(*response).name() == name + "y");
+
+        std::filesystem::remove(large_path);
+    }
+
+    std::filesystem::remove(full_path);
+    std::filesystem::remove(partial_path);
+}
+
+TEST_CASE("ResponseCache", "[response]") {
+    auto full_path = (std::filesystem::temp_directory_path() / "gms_response_cache_full.json").string();
+    auto partial_path = (std::filesystem::temp_directory_path() / "gms_response_cache_partial.txt").string();
+    {
+        std::ofstream full_file(full_path, std::ios::trunc);
+        full_file << R"({"pointCount": 1, "featureCount": 2})";
+        std::ofstream partial_file(partial_path, std::ios::trunc);
+        partial_file << "point_count := 12345\n";
+    }
+    const auto& prototype = routeguide::RouteSummary::default_instance();
+    const std::string method_name = "fixed_price_1234.routeguide.RouteGuide/RecordRoute";
+
+    ResponseCache cache(grpc_mock_server::CacheInvalidation::write_time);
+    auto cached = cache.get(prototype, method_name, full_path);
+    REQUIRE(cached != nullptr);
+    REQUIRE(cache.get(prototype, method_name, full_path) == cached);
+    REQUIRE(cache.size() == 1);
+
+    SECTION("static response is shared") {
+        auto response = cache.build(prototype, method_name, full_path, "", nullptr);
+        REQUIRE(response);
+        REQUIRE(response.isShared());
+        REQUIRE(&response.message() == cached.get());
+    }
+    SECTION("overridden response is a copy") {
+        google::protobuf::Arena arena;
+        auto response = cache.build(prototype, method_name, full_path, partial_path, &arena);
+        REQUIRE(response);
+        REQUIRE_FALSE(response.isShared());
+        REQUIRE(response.message().GetArena() == &arena);
+
+        const auto& summary = static_cast<const routeguide::RouteSummary&>(response.message());
+        REQUIRE(summary.point_count() == 12345);
+        REQUIRE(summary.feature_count() == 2);
+        REQUIRE(static_cast<const routeguide::RouteSummary&>(*cached).point_count() == 1);
+    }
+    SECTION("modified file is reparsed") {
+        {
+            std::ofstream full_file(full_path, std::ios::trunc);
+            full_file << R"({"pointCount": 3})";
+        }
+        std::filesystem::last_write_time(full_path, std::filesystem::last_write_time(full_path) + std::chrono::seconds(1));
+
+        auto modified = cache.get(prototype, method_name, full_path);
+        REQUIRE(modified != nullptr);
+        REQUIRE(modified != cached);
+        REQUIRE(static_cast<const routeguide::RouteSummary&>(*modified).point_count() == 3);
+    }
+    SECTION("modified file is reparsed after clear() only by default") {
+        ResponseCache clear_cache;
+        auto clear_cached = clear_cache.get(prototype, method_name, full_path);
+        REQUIRE(clear_cached != nullptr);
+        {
+            std::ofstream full_file(full_path, std::ios::trunc);
+            full_file << R"({"pointCount": 3})";
+        }
+        std::filesystem::last_write_time(full_path, std::filesystem::last_write_time(full_path) + std::chrono::seconds(1));
+        REQUIRE(clear_cache.get(prototype, method_name, full_path) == clear_cached);
+
+        clear_cache.clear();
+        auto modified = clear_cache.get(prototype, method_name, full_path);
+        REQUIRE(modified != nullptr);
+        REQUIRE(static_cast<const routeguide::RouteSummary&>(*modified).point_count() == 3);
+    }
+    SECTION("missing file") {
+        REQUIRE(cache.get(prototype, method_name, full_path + ".missing") == nullptr);
+        REQUIRE_FALSE(cache.build(prototype, method_name, full_path + ".missing", "", nullptr));
+    }
+    SECTION("serialized override keeps the thread arena") {
+        auto file_full_path = (std::filesystem::temp_directory_path() / "gms_response_cache_file.json").string();
+        auto file_partial_path = (std::filesystem::temp_directory_path() / "gms_response_cache_file.txt").string();
+        {
+            std::ofstream full_file(file_full_path, std::ios::trunc);
+            full_file << R"({"name": "a.proto"})";
+            // Repeated fields are not wire patched, so the response is built and serialized
+            std::ofstream partial_file(file_partial_path, std::ios::trunc);
+            partial_file << "dependency[] := [\"b.proto\"]\n";
+        }
+        const auto& file_prototype = google::protobuf::FileDescriptorProto::default_instance();
+
+        auto& arena = grpc_mock_server::threadArena();
+        auto* kept = google::protobuf::Arena::CreateMessage<routeguide::Feature>(&arena);
+        kept->set_name("kept");
+        const auto space_used = arena.SpaceUsed();
+
+        auto wire = cache.buildWire(file_prototype, "test.Files/Get", file_full_path, file_partial_path);
+        REQUIRE(wire.has_value());
+        REQUIRE(arena.SpaceUsed() == space_used);
+        REQUIRE(kept->name() == "kept");
+
+        std::vector<grpc::Slice> slices;
+        REQUIRE(wire->Dump(&slices).ok());
+        std::string data;
+        for (const auto& slice : slices) {
+            data.append(reinterpret_cast<const char*>(slice.begin()), slice.size());
+        }
+        google::protobuf::FileDescriptorProto file;
+        REQUIRE(file.ParseFromString(data));
+        REQUIRE(file.name() == "a.proto");
+        REQUIRE(file.dependency_size() == 1);
+        REQUIRE(file.dependency(0) == "b.proto");
+
+        arena.Reset();
+        std::filesystem::remove(file_full_path);
+        std::filesystem::remove(file_partial_path);
+    }
+#ifndef WIN32
+    SECTION("file read before clear() is not cached") {
+        auto fifo_path = (std::filesystem::temp_directory_path() / "gms_response_cache_fifo.json").string();
+        std::filesystem::remove(fifo_path);
+        REQUIRE(mkfifo(fifo_path.c_str(), 0600) == 0);
+
+        ResponseCache clear_cache;
+        std::shared_ptr<const google::protobuf::Message> loaded;
+        std::thread loader([&] { loaded = clear_cache.get(prototype, method_name, fifo_path); });
+        {
+            // Opening the writing end waits until the loader opens the file
+            std::ofstream fifo(fifo_path);
+            clear_cache.clear();
+            fifo << R"({"pointCount": 4})";
+        }
+        loader.join();
+        REQUIRE(loaded != nullptr);
+        REQUIRE(clear_cache.size() == 0);
+
+        std::filesystem::remove(fifo_path);
+    }
+#endif // WIN32
+
+    std::filesystem::remove(full_path);
+    std::filesystem::remove(partial_path);
+}
+
+TEST_CASE("BinaryMock", "[response]") {
+    routeguide::Feature feature;
+    feature.set_name("Berkshire Valley");
+    feature.mutable_location()->set_latitude(407838351);
+    routeguide::Feature empty_feature;
+
+    SECTION("write and read") {
+        std::ostringstream output;
+        REQUIRE(grpc_mock_server::writeBinaryMock(output, { &feature, &empty_feature }));
+        auto data = output.str();
+        REQUIRE(grpc_mock_server::isBinaryMock(data));
+
+        auto binary_mock = grpc_mock_server::readBinaryMock(data);
+        REQUIRE(binary_mock.has_value());
+        REQUIRE(binary_mock->m_type_name == "routeguide.Feature");
+        REQUIRE(binary_mock->m_messages.size() == 2);
+        REQUIRE(binary_mock->m_messages[0] == feature.SerializeAsString());
+        REQUIRE(binary_mock->m_messages[1].empty());
+
+        REQUIRE_FALSE(grpc_mock_server::readBinaryMock(data.substr(0, data.size() - 20)).has_value());
+        REQUIRE_FALSE(grpc_mock_server::readBinaryMock(R"({"name": "Berkshire Valley"})").has_value());
+        // Sizes of 2^31 and more are rejected, not read as negative
+        auto header_size = grpc_mock_server::kBinaryMockMagic.size() + 4;
+        REQUIRE_FALSE(grpc_mock_server::readBinaryMock(data.substr(0, header_size) + std::string("\xF0\xFF\xFF\xFF\x0F", 5) + "x").has_value());
+        REQUIRE_FALSE(grpc_mock_server::readBinaryMock(data.substr(0, header_size + 19) + std::string("\x80\x80\x80\x80\x08", 5)).has_value());
+        routeguide::Point point;
+        REQUIRE_FALSE(grpc_mock_server::writeBinaryMock(output, { &feature, &point }));
+        REQUIRE_FALSE(grpc_mock_server::writeBinaryMock(output, {}));
+    }
+    SECTION("binary full response") {
+        auto full_path = (std::filesystem::temp_directory_path() / "gms_binary_mock.binpb").string();
+        {
+            std::ofstream full_file(full_path, std::ios::trunc | std::ios::binary);
+            REQUIRE(grpc_mock_server::writeBinaryMock(full_file, { &feature }));
+        }
+
+        ResponseCache cache;
+        auto response = cache.get(routeguide::Feature::default_instance(), "gms_binary_mock.routeguide.RouteGuide/GetFeature", full_path);
+        REQUIRE(response);
+        REQUIRE(google::protobuf::util::MessageDifferencer::Equals(*response, feature));
+        auto wire = cache.getWire(routeguide::Feature::default_instance(), "gms_binary_mock.routeguide.RouteGuide/GetFeature", full_path);
+        REQUIRE(wire.has_value());
+        grpc::Slice wire_slice;
+        REQUIRE(wire->TrySingleSlice(&wire_slice).ok());
+        REQUIRE(std::string(reinterpret_cast<const char*>(wire_slice.begin()), wire_slice.size()) == feature.SerializeAsString());
+
+        // The header names the type, a response of another type is rejected
+        REQUIRE(grpc_mock_server::loadResponse(routeguide::Point::default_instance(), full_path, nullptr) == nullptr);
+
+        std::filesystem::remove(full_path);
+    }
+    SECTION("config format attribute") {
+        REQUIRE(Config::instance().parse(
+            "<root><dataset name=\"gms_binary_mock\"><package name=\"routeguide\"><service name=\"RouteGuide\">"
+            "<method name=\"GetFeature\"><full path=\"get_feature.bin\" format=\"binary\" /></method>"
+            "</service></package></dataset></root>"
+        ));
+        REQUIRE_FALSE(Config::instance().parse(
+            "<root><dataset name=\"gms_binary_mock\"><package name=\"routeguide\"><service name=\"RouteGuide\">"
+            "<method name=\"GetFeature\"><full path=\"get_feature.yaml\" format=\"yaml\" /></method>"
+            "</service></package></dataset></root>"
+        ));
+    }
+}
+
+TEST_CASE("MockGenericService", "[generic_service]") {
+    SECTION("responsePrototype") {
+        REQUIRE(MockGenericService::responsePrototype("/routeguide.RouteGuide/GetFeature") == &routeguide::Feature::default_instance());
+        REQUIRE(MockGenericService::responsePrototype("/routeguide.RouteGuide/RecordRoute") == nullptr);
+        REQUIRE(MockGenericService::responsePrototype("/routeguide.RouteGuide/Missing") == nullptr);
+        REQUIRE(MockGenericService::responsePrototype("routeguide.RouteGuide/GetFeature") == nullptr);
+    }
+    SECTION("static response is served from the cached wire bytes") {
+        auto full_path = (std::filesystem::temp_directory_path() / "gms_generic_service_full.json").string();
+        {
+            std::ofstream full_file(full_path, std::ios::trunc);
+            full_file << R"({"name": "Berkshire Valley", "location": {"latitude": 407838351}})";
+        }
+        REQUIRE(Config::instance().parse(
+            "<root><dataset name=\"gms_generic_service\"><package name=\"routeguide\"><service name=\"RouteGuide\">"
+            "<method name=\"GetFeature\"><full path=\"" + full_path + "\" /></method>"
+            "</service></package></dataset></root>"
+        ));
+
+        ResponseCache cache;
+        MockGenericService service(cache);
+        auto config = Config::instance().snapshot();
+        auto method = config->findMethod("gms_generic_service", "/routeguide.RouteGuide/GetFeature");
+        REQUIRE(method != nullptr);
+        auto wire = service.respond(*method, "/routeguide.RouteGuide/GetFeature");
+        REQUIRE(wire.has_value());
+        REQUIRE(cache.size() == 1);
+
+        grpc::Slice wire_slice;
+        REQUIRE(wire->TrySingleSlice(&wire_slice).ok());
+        routeguide::Feature feature;
+        REQUIRE(feature.ParseFromArray(wire_slice.begin(), static_cast<int>(wire_slice.size())));
+        REQUIRE(feature.name() == "Berkshire Valley");
+        REQUIRE(feature.location().latitude() == 407838351);
+
+        REQUIRE_FALSE(service.respond(ConfigSnapshot::MethodDescription(), "/routeguide.RouteGuide/GetFeature").has_value());
+
+        std::filesystem::remove(full_path);
+    }
+}
+
+TEST_CASE("MetricsRegistry", "[metrics]") {
+    SECTION("histogram buckets") {
+        for (std::uint64_t value : { 0ull, 1ull, 7ull, 8ull, 15ull, 16ull, 1000ull, 123456789ull, 1ull << 35 }) {
+            auto index = MethodMetrics::bucketIndex(value);
+            REQUIRE(MethodMetrics::bucketUpperBound(index) >= value);
+            REQUIRE((index == 0 || MethodMetrics::bucketUpperBound(index - 1) < value));
+        }
+        for (std::size_t i = 1; i < MethodMetrics::kBucketCount; i++) {
+            REQUIRE(MethodMetrics::bucketUpperBound(i) > MethodMetrics::bucketUpperBound(i - 1));
+        }
+        REQUIRE(MethodMetrics::bucketIndex(std::numeric_limits<std::uint64_t>::max()) == MethodMetrics::kOverflowBucket);
+        // Values too large for the regular buckets do not inflate the last one
+        REQUIRE(MethodMetrics::bucketIndex((1ull << 36) - 1) == MethodMetrics::kOverflowBucket - 1);
+        REQUIRE(MethodMetrics::bucketUpperBound(MethodMetrics::kOverflowBucket - 1) == (1ull << 36) - 1);
+        REQUIRE(MethodMetrics::bucketIndex(1ull << 36) == MethodMetrics::kOverflowBucket);
+    }
+    SECTION("counters and stage histograms") {
+        MetricsRegistry registry;
+        auto metrics = registry.method("gms_metrics.routeguide.RouteGuide/GetFeature");
+        REQUIRE(metrics != nullptr);
+        REQUIRE(registry.method("gms_metrics.routeguide.RouteGuide/GetFeature") == metrics);
+        REQUIRE(registry.find("gms_metrics.routeguide.RouteGuide/GetFeature") == metrics);
+        REQUIRE(registry.find("gms_metrics.routeguide.RouteGuide/Missing") == nullptr);
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; i++) {
+            threads.emplace_back([metrics] {
+                for (int call = 0; call < 1000; call++) {
+                    metrics->recordCall(call % 10 != 0);
+                    metrics->recordStage(MethodMetrics::Stage::load, std::chrono::microseconds(call < 990 ? 10 : 1000));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        REQUIRE(metrics->callCount() == 4000);
+        REQUIRE(metrics->errorCount() == 400);
+        auto load = metrics->histogram(MethodMetrics::Stage::load);
+        REQUIRE(load.m_count == 4000);
+        REQUIRE(load.m_sum_ns == 4 * (990 * 10000ull + 10 * 1000000ull));
+        REQUIRE(load.percentile(0.5) >= std::chrono::microseconds(10));
+        REQUIRE(load.percentile(0.5) < std::chrono::microseconds(12));
+        REQUIRE(load.percentile(0.999) >= std::chrono::microseconds(1000));
+        REQUIRE(metrics->histogram(MethodMetrics::Stage::serialize).m_count == 0);
+
+        auto text = registry.renderPrometheus();
+        REQUIRE(text.find("# TYPE grpc_mock_server_stage_duration_seconds histogram\n") != std::string::npos);
+        REQUIRE(text.find("grpc_mock_server_calls_total{method=\"gms_metrics.routeguide.RouteGuide/GetFeature\"} 4000\n") != std::string::npos);
+        REQUIRE(text.find("grpc_mock_server_call_errors_total{method=\"gms_metrics.routeguide.RouteGuide/GetFeature\"} 400\n") != std::string::npos);
+        REQUIRE(text.find(
+            "grpc_mock_server_stage_duration_seconds_bucket{method=\"gms_metrics.routeguide.RouteGuide/GetFeature\",stage=\"load\",le=\"+Inf\"} 4000\n"
+        ) != std::string::npos);
+        REQUIRE(text.find("stage=\"serialize\"") == std::string::npos);
+
+        // Fixed le set: a bucket per power of two, empty ones included
+        std::size_t load_bucket_count = 0;
+        for (auto pos = text.find("stage=\"load\",le="); pos != std::string::npos; pos = text.find("stage=\"load\",le=", pos + 1)) {
+            load_bucket_count++;
+        }
+        REQUIRE(load_bucket_count == MethodMetrics::kRegularBucketCount / MethodMetrics::kSubBucketCount + 1);
+        REQUIRE(text.find("stage=\"load\",le=\"7e-09\"} 0\n") != std::string::npos);
+        REQUIRE(text.find("stage=\"load\",le=\"1.6383e-05\"} 3960\n") != std::string::npos);
+        REQUIRE(text.find("stage=\"load\",le=\"0.001048575\"} 4000\n") != std::string::npos);
+    }
+    SECTION("generic service records the stages") {
+        auto full_path = (std::filesystem::temp_directory_path() / "gms_metrics_full.json").string();
+        {
+            std::ofstream full_file(full_path, std::ios::trunc);
+            full_file << R"({"name": "Berkshire Valley"})";
+        }
+        REQUIRE(Config::instance().parse(
+            "<root><dataset name=\"gms_metrics\"><package name=\"routeguide\"><service name=\"RouteGuide\">"
+            "<method name=\"GetFeature\"><full path=\"" + full_path + "\" /></method>"
+            "</service></package></dataset></root>"
+        ));
+
+        ResponseCache cache;
+        MockGenericService service(cache);
+        MethodMetrics metrics("gms_metrics.routeguide.RouteGuide/GetFeature");
+        auto config = Config::instance().snapshot();
+        auto method = config->findMethod("gms_metrics", "/routeguide.RouteGuide/GetFeature");
+        REQUIRE(method != nullptr);
+        REQUIRE(service.respond(*method, "/routeguide.RouteGuide/GetFeature", &metrics).has_value());
+        REQUIRE(service.respond(*method, "/routeguide.RouteGuide/GetFeature", &metrics).has_value());
+        REQUIRE(metrics.histogram(MethodMetrics::Stage::load).m_count == 2);
+        REQUIRE(metrics.histogram(MethodMetrics::Stage::override_apply).m_count == 0);
+
+        // Resolved once per snapshot method, to the registry entry of the method key
+        auto method_metrics = config->methodMetrics(*method);
+        REQUIRE(method_metrics != nullptr);
+        REQUIRE(config->methodMetrics(*method) == method_metrics);
+        REQUIRE(MetricsRegistry::instance().find("gms_metrics.routeguide.RouteGuide/GetFeature") == method_metrics);
+
+        std::filesystem::remove(full_path);
+    }
+}
+
+#ifndef WIN32
+
+namespace {
+
+// Whole response of a single HTTP request to the local port, empty if the connection fails
+std::string httpGet(int port, const std::string& path) {
+    int connection = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<std::uint16_t>(port));
+    if (connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(connection);
+        return std::string();
+    }
+
+    auto request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    send(connection, request.data(), request.size(), 0);
+    std::string response;
+    char buffer[4096];
+    ssize_t read_size = 0;
+    while ((read_size = recv(connection, buffer, sizeof(buffer), 0)) > 0) {
+        response.append(buffer, static_cast<std::size_t>(read_size));
+    }
+    close(connection);
+    return response;
+}
+
+} // anonymous namespace
+
+#endif // WIN32
+
+TEST_CASE("MetricsHttpServer", "[metrics]") {
+    MetricsRegistry registry;
+    registry.method("gms_metrics_http.routeguide.RouteGuide/GetFeature")->recordCall(true);
+    MetricsHttpServer server(registry);
+
+#ifdef WIN32
+    REQUIRE_FALSE(server.start(0));
+#else
+    REQUIRE(server.start(0));
+    REQUIRE(server.port() > 0);
+
+    auto response = httpGet(server.port(), "/metrics");
+    REQUIRE(response.starts_with("HTTP/1.1 200 OK\r\n"));
+    REQUIRE(response.find("Content-Type: text/plain; version=0.0.4") != std::string::npos);
+    REQUIRE(response.ends_with("\r\n\r\n" + registry.renderPrometheus()));
+    REQUIRE(response.find("grpc_mock_server_calls_total{method=\"gms_metrics_http.routeguide.RouteGuide/GetFeature\"} 1\n") != std::string::npos);
+
+    REQUIRE(httpGet(server.port(), "/other").starts_with("HTTP/1.1 404 Not Found\r\n"));
+
+    auto port = server.port();
+    server.stop();
+    REQUIRE(server.port() == 0);
+    REQUIRE(httpGet(port, "/metrics").empty());
+#endif // WIN32
+}
+
+namespace {
+
+class RouteGuideUpstream : public routeguide::RouteGuide::Service {
+public:
+    std::atomic<int> m_call_count = 0;
+
+    grpc::Status GetFeature(grpc::ServerContext*, const routeguide::Point* request, routeguide::Feature* response) override {
+        m_call_count++;
+        response->set_name("upstream");
+        *response->mutable_location() = *request;
+        return grpc::Status::OK;
+    }
+};
+
+} // anonymous namespace
+
+TEST_CASE("ChannelPool", "[record_replay]") {
+    ChannelPool::Settings settings;
+    settings.channel_count = 3;
+    settings.keepalive_time = std::chrono::seconds(30);
+    ChannelPool pool("127.0.0.1:1", grpc::InsecureChannelCredentials(), settings);
+    REQUIRE(pool.size() == 3);
+    REQUIRE(pool.target() == "127.0.0.1:1");
+    REQUIRE(pool.channel(0) != pool.channel(1));
+
+    // Round robin
+    auto first = &pool.stub();
+    REQUIRE(&pool.stub() != first);
+    REQUIRE(&pool.stub() != first);
+    REQUIRE(&pool.stub() == first);
+
+    REQUIRE(Config::instance().parse("<root><dataset name=\"d\"><package name=\"p\"><service name=\"s\"><method name=\"m\" /></service></package></dataset></root>"));
+    REQUIRE(ChannelPool::fromConfig(*Config::instance().snapshot()) == nullptr);
+}
+
+TEST_CASE("RecordReplayService", "[record_replay]") {
+    auto directory = std::filesystem::temp_directory_path() / "gms_record_replay";
+    std::filesystem::remove_all(directory);
+
+    SECTION("recordingPath") {
+        REQUIRE(RecordStore::recordingPath(directory, "ds", "/routeguide.RouteGuide/GetFeature") == directory / "ds" / "routeguide.RouteGuide" / "GetFeature.json");
+        REQUIRE(RecordStore::recordingPath(directory, "", "routeguide.RouteGuide/GetFeature") == directory / "_" / "routeguide.RouteGuide" / "GetFeature.json");
+        REQUIRE_FALSE(RecordStore::recordingPath(directory, "..", "/routeguide.RouteGuide/GetFeature").has_value());
+        REQUIRE_FALSE(RecordStore::recordingPath(directory, "ds", "/GetFeature").has_value());
+    }
+    SECTION("unmocked calls are forwarded once and replayed") {
+        RouteGuideUpstream upstream;
+        int upstream_port = 0;
+        grpc::ServerBuilder upstream_builder;
+        upstream_builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(), &upstream_port);
+        upstream_builder.RegisterService(&upstream);
+        auto upstream_server = upstream_builder.BuildAndStart();
+        REQUIRE(upstream_server);
+
+        REQUIRE(Config::instance().parse(
+            "<root><remote_host_url name=\"127.0.0.1\" /><remote_host_port name=\"" + std::to_string(upstream_port) + "\" />"
+            "<dataset name=\"other\"><package name=\"p\"><service name=\"s\"><method name=\"m\" /></service></package></dataset></root>"
+        ));
+        auto channel_pool = ChannelPool::fromConfig(*Config::instance().snapshot());
+        REQUIRE(channel_pool);
+
+        auto getFeature = [](routeguide::RouteGuide::Stub& stub, routeguide::Feature& response) {
+            grpc::ClientContext context;
+            context.AddMetadata("gms_dataset", "recorded");
+            routeguide::Point request;
+            request.set_latitude(7);
+            return stub.GetFeature(&context, request, &response);
+        };
+
+        {
+            RecordStore store(directory);
+            ResponseCache cache;
+            RecordReplayService service(store, channel_pool, cache);
+            int proxy_port = 0;
+            grpc::ServerBuilder proxy_builder;
+            proxy_builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(), &proxy_port);
+            proxy_builder.RegisterCallbackGenericService(&service);
+            auto proxy_server = proxy_builder.BuildAndStart();
+            auto stub = routeguide::RouteGuide::NewStub(grpc::CreateChannel("127.0.0.1:" + std::to_string(proxy_port), grpc::InsecureChannelCredentials()));
+
+            for (int i = 0; i < 3; i++) {
+                routeguide::Feature response;
+                REQUIRE(getFeature(*stub, response).ok());
+                REQUIRE(response.name() == "upstream");
+                REQUIRE(response.location().latitude() == 7);
+            }
+            REQUIRE(upstream.m_call_count == 1);
+            REQUIRE(store.size() == 1);
+            proxy_server->Shutdown();
+        }
+        upstream_server->Shutdown();
+
+        // Recordings survive the restart, the remote host is not needed anymore
+        RecordStore store(directory);
+        auto recording = store.find("recorded", "/routeguide.RouteGuide/GetFeature");
+        REQUIRE(recording != nullptr);
+        REQUIRE(recording->m_method_name == "recorded.routeguide.RouteGuide/GetFeature");
+
+        ResponseCache cache;
+        RecordReplayService service(store, nullptr, cache);
+        int proxy_port = 0;
+        grpc::ServerBuilder proxy_builder;
+        proxy_builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(), &proxy_port);
+        proxy_builder.RegisterCallbackGenericService(&service);
+        auto proxy_server = proxy_builder.BuildAndStart();
+        auto stub = routeguide::RouteGuide::NewStub(grpc::CreateChannel("127.0.0.1:" + std::to_string(proxy_port), grpc::InsecureChannelCredentials()));
+        routeguide::Feature response;
+        REQUIRE(getFeature(*stub, response).ok());
+        REQUIRE(response.name() == "upstream");
+        proxy_server->Shutdown();
+    }
+    SECTION("concurrent first calls record once") {
+        RouteGuideUpstream upstream;
+        int upstream_port = 0;
+        grpc::ServerBuilder upstream_builder;
+        upstream_builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(), &upstream_port);
+        upstream_builder.RegisterService(&upstream);
+        auto upstream_server = upstream_builder.BuildAndStart();
+        REQUIRE(upstream_server);
+
+        REQUIRE(Config::instance().parse(
+            "<root><remote_host_url name=\"127.0.0.1\" /><remote_host_port name=\"" + std::to_string(upstream_port) + "\" />"
+            "<dataset name=\"other\"><package name=\"p\"><service name=\"s\"><method name=\"m\" /></service></package></dataset></root>"
+        ));
+        {
+            RecordStore store(directory);
+            REQUIRE(store.beginRecording("ds", "/routeguide.RouteGuide/GetFeature"));
+            REQUIRE_FALSE(store.beginRecording("ds", "routeguide.RouteGuide/GetFeature"));
+            store.cancelRecording("ds", "/routeguide.RouteGuide/GetFeature");
+            REQUIRE(store.beginRecording("ds", "/routeguide.RouteGuide/GetFeature"));
+            store.cancelRecording("ds", "/routeguide.RouteGuide/GetFeature");
+
+            ResponseCache cache;
+            RecordReplayService service(store, ChannelPool::fromConfig(*Config::instance().snapshot()), cache);
+            int proxy_port = 0;
+            grpc::ServerBuilder proxy_builder;
+            proxy_builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(), &proxy_port);
+            proxy_builder.RegisterCallbackGenericService(&service);
+            auto proxy_server = proxy_builder.BuildAndStart();
+            auto channel = grpc::CreateChannel("127.0.0.1:" + std::to_string(proxy_port), grpc::InsecureChannelCredentials());
+
+            std::atomic<int> ok_count = 0;
+            std::vector<std::thread> threads;
+            for (int i = 0; i < 8; i++) {
+                threads.emplace_back([&channel, &ok_count] {
+                    auto stub = routeguide::RouteGuide::NewStub(channel);
+                    grpc::ClientContext context;
+                    context.AddMetadata("gms_dataset", "concurrent");
+                    routeguide::Point request;
+                    routeguide::Feature response;
+                    if (stub->GetFeature(&context, request, &response).ok() && response.name() == "upstream") {
+                        ok_count++;
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            REQUIRE(ok_count == 8);
+            REQUIRE(upstream.m_call_count >= 1);
+            REQUIRE(store.size() == 1);
+            proxy_server->Shutdown();
+        }
+        upstream_server->Shutdown();
+
+        // Single recording, no temporary file is left behind
+        std::size_t file_count = 0;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
+            if (entry.is_regular_file()) {
+                REQUIRE(entry.path().extension() == ".json");
+                file_count++;
+            }
+        }
+        REQUIRE(file_count == 1);
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("CompiledOverrideProgram::wirePatch", "[wire_patch]") {
+    const auto& language = RequestLanguage::instance();
+
+    routeguide::Feature base;
+    base.set_name("Berkshire Valley");
+    base.mutable_location()->set_latitude(407838351);
+    base.mutable_location()->set_longitude(-746143763);
+    const auto base_data = base.SerializeAsString();
+
+    auto applyPatch = [&](const std::string& program_text) {
+        auto program = MessageWrapper::compile(language, program_text);
+        REQUIRE(program != nullptr);
+        auto wire_patch = program->wirePatch(routeguide::Feature::descriptor());
+        REQUIRE(wire_patch != nullptr);
+        REQUIRE(program->wirePatch(routeguide::Feature::descriptor()) == wire_patch);
+
+        routeguide::Feature expected = base;
+        REQUIRE(program->apply(expected));
+        routeguide::Feature patched;
+        REQUIRE(patched.ParseFromString(base_data + *wire_patch));
+        REQUIRE(google::protobuf::util::MessageDifferencer::Equals(patched, expected));
+        return patched;
+    };
+
+    SECTION("top-level scalar field") {
+        auto patched = applyPatch("name := \"patched\"\n");
+        REQUIRE(patched.name() == "patched");
+    }
+    SECTION("nested singular field is merged") {
+        auto patched = applyPatch("location.latitude := -5\n");
+        REQUIRE(patched.location().latitude() == -5);
+        REQUIRE(patched.location().longitude() == -746143763);
+    }
+    SECTION("default value overrides the base one") {
+        auto patched = applyPatch("location.longitude := 0\nname := \"\"\n");
+        REQUIRE(patched.location().longitude() == 0);
+        REQUIRE(patched.name().empty());
+    }
+    SECTION("repeated fields are not patched") {
+        auto program = MessageWrapper::compile(language, "dependency[] := [\"b.proto\"]\n");
+        REQUIRE(program != nullptr);
+        REQUIRE(program->wirePatch(google::protobuf::FileDescriptorProto::descriptor()) == nullptr);
+    }
+}
+
+TEST_CASE("RequestLanguage backends agree", "[message_wrapper]") {
+    using Backend = RequestLanguage::Backend;
+    const auto& language = RequestLanguage::instance();
+
+    SECTION("hand-picked programs") {
+        const std::vector<std::string> programs = {
+            "",
+            "# comment only\n",
+            "# comment without new line",
+            "point_count := 12345\n",
+            "point_count := 12345",
+            "lo.latitude := -409146138\r\n",
+            "features[].location.latitude := 0\n",
+            "distance := 3.5\n",
+            "distance := 0.5.7\n",
+            "distance := -0\n",
+            "distance := 0123\n",
+            "name := \"Berkshire \\\"Valley\\\" \\u00e9\"\n",
+            "name := \"bad escape \\q\"\n",
+            "name := \"\xc3\xa9\"\n",
+            "enabled := true\nvisible := false\n\n# comment\nlocation := null\n",
+            "enabled := trueish\n",
+            "location := nullable\n",
+            "kind := KIND_TRAIL\n",
+            "kind := KIND[]\n",
+            "values[] := [1,2,3]\n",
+            "values[] := [1,]\n",
+            "values[] := [\"a\",B,null,-2.5,true]\n",
+            "values[] := [[1]]\n",
+            "lo. := 1\n",
+            " lo := 1\n",
+            "lo := 1 \n",
+            "\nlo := 1\n",
+            "lo:=1\n",
+            "lo \t:=\t 1\n",
+        };
+        for (const auto& program : programs) {
+            INFO(program);
+            REQUIRE((language.parse(program, Backend::Native) == language.parse(program, Backend::Peg)));
+        }
+    }
+    SECTION("random programs") {
+        const std::vector<std::string> fragments = {
+            "point_count", "lo", "features[]", "_x1", ".", "[]", " ", "\t", ":=", "=", "\n", "\r\n", "#", "null", "true", "false",
+            "0", "-", "12", "3.25", ".5", "\"", "\\\"", "\\u00e9", "\\q", "abc", "[", "]", ",", "KIND_TRAIL"
+        };
+        std::mt19937 generator(20221017);
+        std::uniform_int_distribution<std::size_t> fragment_distribution(0, fragments.size() - 1);
+        std::uniform_int_distribution<int> length_distribution(1, 24);
+        for (int i = 0; i < 5000; i++) {
+            std::string program;
+            int length = length_distribution(generator);
+            for (int j = 0; j < length; j++) {
+                program += fragments[fragment_distribution(generator)];
+            }
+            // Every other program starts from a valid statement, so that deeper rules are exercised as well
+            if (i % 2 == 0) {
+                program = "lo.latitude := 1\n" + program + "\n";
+            }
+            INFO(program);
+            REQUIRE((language.parse(program, Backend::Native) == language.parse(program, Backend::Peg)));
+        }
+    }
+}
@@ -0,0 +1,369 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include <grpc_mock_server_call_log.h>
+#include <grpc_mock_server_configuration.h>
+#include <grpc_mock_server_generic_service.h>
+#include <grpc_mock_server_metrics.h>
+#include <grpc_mock_server_utils.h>
+#include "generated_code/test.grpc.pb.h"
+
+#include <grpcpp/grpcpp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr std::string_view kDatasetName = "load_test";
+constexpr std::string_view kMethodPath = "/routeguide.RouteGuide/GetFeature";
+
+std::atomic<std::uint64_t> logged_call_count = 0;
+
+// Calls are logged the way the generated servers do it, on the logging thread
+CallLog& callLog() {
+    static CallLog call_log(grpcMockServerMethodCallback, 65536, spdlog::async_overflow_policy::overrun_oldest);
+    return call_log;
+}
+
+grpc::Status buildMock(const ConfigSnapshot::MethodDescription& method, routeguide::Feature& response, MethodMetrics* metrics) {
+    if (!method.m_full_path.empty()) {
+        StageTimer load_timer(metrics, MethodMetrics::Stage::load);
+        auto full_response = ResponseCache::instance().get(response, method.m_method_name, method.m_full_path);
+        if (!full_response) {
+            return grpc::Status(grpc::INTERNAL, "invalid full response " + method.m_full_path);
+        }
+        response.CopyFrom(*full_response);
+    }
+    if (!method.m_partial_path.empty()) {
+        StageTimer override_timer(metrics, MethodMetrics::Stage::override_apply);
+        if (!evalRequestFile(response, method.m_method_name, method.m_partial_path)) {
+            return grpc::Status(grpc::INTERNAL, "invalid partial override " + method.m_partial_path);
+        }
+    }
+    return grpc::Status::OK;
+}
+
+grpc::Status respondMock(grpc::ServerContext* context, const routeguide::Point& request, routeguide::Feature& response) {
+    auto config = Config::instance().snapshot();
+    auto method = config->findMethod(getDatasetNameView(context), kMethodPath);
+    if (method == nullptr) {
+        return grpc::Status(grpc::UNIMPLEMENTED, "no mock data for " + std::string(kMethodPath));
+    }
+
+    auto metrics = config->methodMetrics(*method);
+    auto status = buildMock(*method, response, metrics);
+    if (metrics != nullptr) {
+        metrics->recordCall(status.ok());
+    }
+    if (!status.ok()) {
+        return status;
+    }
+
+    CallTrace trace(
+        current_unix_time(),
+        std::string(kMethodPath),
+        LazyMessageJson(LazyMessageJson::copyMessage(request)),
+        grpc::OK,
+        LazyMessageJson(LazyMessageJson::copyMessage(response))
+    );
+    trace.m_metrics = metrics;
+    callLog().push(std::move(trace));
+    return grpc::Status::OK;
+}
+
+class RouteGuideMock : public routeguide::RouteGuide::Service {
+public:
+    grpc::Status GetFeature(grpc::ServerContext* context, const routeguide::Point* request, routeguide::Feature* response) override {
+        return respondMock(context, *request, *response);
+    }
+};
+
+class StreamedRouteGuideMock : public routeguide::RouteGuide::StreamedUnaryService {
+public:
+    grpc::Status StreamedGetFeature(
+        grpc::ServerContext* context,
+        grpc::ServerUnaryStreamer<routeguide::Point, routeguide::Feature>* server_unary_streamer
+    ) override {
+        routeguide::Point request;
+        if (!server_unary_streamer->Read(&request)) {
+            return grpc::Status(grpc::INTERNAL, "no request message");
+        }
+        routeguide::Feature response;
+        auto status = respondMock(context, request, response);
+        if (status.ok()) {
+            server_unary_streamer->Write(response);
+        }
+        return status;
+    }
+};
+
+struct Options {
+    std::size_t thread_count = 4;
+    std::chrono::seconds duration = std::chrono::seconds(5);
+    std::string scenario = "all";
+    // Prometheus metrics are served on the port during the run if it is set
+    std::optional<int> metrics_port;
+};
+
+struct Result {
+    std::uint64_t call_count = 0;
+    std::uint64_t error_count = 0;
+    double seconds = 0;
+    std::vector<std::uint32_t> latencies_us;
+};
+
+auto parseOptions(int argc, char* argv[]) -> std::optional<Options> {
+    Options result;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string_view name = argv[i];
+        std::string value = argv[i + 1];
+        if (name == "--threads") {
+            result.thread_count = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (name == "--seconds") {
+            result.duration = std::chrono::seconds(std::max(1, std::atoi(value.c_str())));
+        }
+        else if (name == "--scenario") {
+            if (value != "unary" && value != "streamed" && value != "generic" && value != "all") {
+                return std::nullopt;
+            }
+            result.scenario = value;
+        }
+        else if (name == "--metrics-port") {
+            result.metrics_port = std::atoi(value.c_str());
+        }
+        else {
+            return std::nullopt;
+        }
+    }
+    if (argc % 2 == 0) {
+        return std::nullopt;
+    }
+    return result;
+}
+
+// Mock data and config of the load_test dataset, the partial override is applied on every call
+bool prepareMockData(const std::filesystem::path& directory) {
+    std::filesystem::create_directories(directory);
+    auto full_path = (directory / "get_feature.json").string();
+    auto partial_path = (directory / "get_feature.txt").string();
+    {
+        std::ofstream full_file(full_path, std::ios::trunc);
+        full_file << R"({"name": "Berkshire Valley Management Area Trail, Jefferson, NJ, USA", "location": {"latitude": 409146138, "longitude": -746188906}})";
+        std::ofstream partial_file(partial_path, std::ios::trunc);
+        partial_file << "location.latitude := 407838351\n";
+    }
+
+    return Config::instance().parse(
+        "<root><dataset name=\"" + std::string(kDatasetName) + "\"><package name=\"routeguide\"><service name=\"RouteGuide\">"
+        "<method name=\"GetFeature\"><full path=\"" + full_path + "\" /><partial path=\"" + partial_path + "\" /></method>"
+        "</service></package></dataset></root>"
+    );
+}
+
+auto runClients(const std::string& target, const Options& options) -> Result {
+    std::atomic<bool> running = true;
+    std::vector<Result> thread_results(options.thread_count);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < options.thread_count; i++) {
+        threads.emplace_back([&, i] {
+            // Own connection per client thread
+            grpc::ChannelArguments arguments;
+            arguments.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+            auto stub = routeguide::RouteGuide::NewStub(grpc::CreateCustomChannel(target, grpc::InsecureChannelCredentials(), arguments));
+
+            auto& result = thread_results[i];
+            result.latencies_us.reserve(1 << 20);
+            routeguide::Point request;
+            request.set_latitude(409146138);
+            request.set_longitude(-746188906);
+            while (running.load(std::memory_order_relaxed)) {
+                grpc::ClientContext context;
+                context.AddMetadata("gms_dataset", std::string(kDatasetName));
+                routeguide::Feature response;
+
+                auto call_start = std::chrono::steady_clock::now();
+                auto status = stub->GetFeature(&context, request, &response);
+                auto latency = std::chrono::steady_clock::now() - call_start;
+
+                result.call_count++;
+                if (!status.ok()) {
+                    result.error_count++;
+                }
+                result.latencies_us.push_back(static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(latency).count()));
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(options.duration);
+    running = false;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    Result result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (auto& thread_result : thread_results) {
+        result.call_count += thread_result.call_count;
+        result.error_count += thread_result.error_count;
+        result.latencies_us.insert(result.latencies_us.end(), thread_result.latencies_us.begin(), thread_result.latencies_us.end());
+    }
+    std::sort(result.latencies_us.begin(), result.latencies_us.end());
+    return result;
+}
+
+std::uint32_t percentile(const std::vector<std::uint32_t>& sorted_values, double fraction) {
+    if (sorted_values.empty()) {
+        return 0;
+    }
+    auto index = static_cast<std::size_t>(std::ceil(fraction * sorted_values.size()));
+    return sorted_values[std::clamp<std::size_t>(index, 1, sorted_values.size()) - 1];
+}
+
+void printResult(const std::string& scenario, const Options& options, const Result& result) {
+    std::cout << std::left << std::setw(16) << scenario
+        << std::right << std::setw(8) << options.thread_count
+        << std::setw(12) << result.call_count
+        << std::setw(8) << result.error_count
+        << std::setw(12) << static_cast<std::uint64_t>(result.call_count / result.seconds)
+        << std::setw(10) << percentile(result.latencies_us, 0.5)
+        << std::setw(10) << percentile(result.latencies_us, 0.99)
+        << std::setw(10) << percentile(result.latencies_us, 0.999)
+        << std::endl;
+}
+
+// Server side stage times of all the scenarios together
+void printStages() {
+    std::cout << std::endl << std::left << std::setw(16) << "stage"
+        << std::right << std::setw(12) << "count"
+        << std::setw(10) << "p50 ns"
+        << std::setw(10) << "p99 ns"
+        << std::setw(10) << "p999 ns"
+        << std::endl;
+    for (const auto* metrics : MetricsRegistry::instance().methods()) {
+        for (std::size_t stage_index = 0; stage_index < MethodMetrics::kStageCount; stage_index++) {
+            auto stage = static_cast<MethodMetrics::Stage>(stage_index);
+            auto histogram = metrics->histogram(stage);
+            std::cout << std::left << std::setw(16) << MethodMetrics::stageName(stage)
+                << std::right << std::setw(12) << histogram.m_count
+                << std::setw(10) << histogram.percentile(0.5).count()
+                << std::setw(10) << histogram.percentile(0.99).count()
+                << std::setw(10) << histogram.percentile(0.999).count()
+                << std::endl;
+        }
+    }
+}
+
+// Starts the in-process server with the service on a free localhost port and drives it with the clients
+template <typename ServiceRegistration>
+bool runScenario(const std::string& scenario, const Options& options, ServiceRegistration&& register_service) {
+    int port = 0;
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(), &port);
+    register_service(builder);
+    auto server = builder.BuildAndStart();
+    if (!server || port == 0) {
+        std::cerr << "ERROR: unable to start the server for " << scenario << std::endl;
+        return false;
+    }
+
+    auto result = runClients("127.0.0.1:" + std::to_string(port), options);
+    server->Shutdown();
+    printResult(scenario, options, result);
+    return result.error_count == 0;
+}
+
+} // anonymous namespace
+
+void grpcMockServerMethodCallback(
+    time_t,
+    const std::string&,
+    const std::string&,
+    int,
+    const std::string&
+) {
+    logged_call_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+int main(int argc, char* argv[]) {
+    auto options = parseOptions(argc, argv);
+    if (!options.has_value()) {
+        std::cerr << "usage: " << argv[0] << " [--threads N] [--seconds N] [--scenario unary|streamed|generic|all] [--metrics-port N]" << std::endl;
+        return 1;
+    }
+
+    auto directory = std::filesystem::temp_directory_path() / "grpc_mock_server_load_test";
+    if (!prepareMockData(directory)) {
+        std::cerr << "ERROR: invalid mock config" << std::endl;
+        return 1;
+    }
+
+    MetricsHttpServer metrics_server;
+    if (options->metrics_port.has_value()) {
+        if (!metrics_server.start(options->metrics_port.value())) {
+            return 1;
+        }
+        std::cout << "metrics: http://127.0.0.1:" << metrics_server.port() << "/metrics" << std::endl;
+    }
+
+    std::cout << std::left << std::setw(16) << "scenario"
+        << std::right << std::setw(8) << "threads"
+        << std::setw(12) << "calls"
+        << std::setw(8) << "errors"
+        << std::setw(12) << "qps"
+        << std::setw(10) << "p50 us"
+        << std::setw(10) << "p99 us"
+        << std::setw(10) << "p999 us"
+        << std::endl;
+
+    bool ok = true;
+    const auto& scenario = options->scenario;
+    if (scenario == "unary" || scenario == "all") {
+        RouteGuideMock service;
+        ok &= runScenario("unary", options.value(), [&](grpc::ServerBuilder& builder) { builder.RegisterService(&service); });
+    }
+    if (scenario == "streamed" || scenario == "all") {
+        StreamedRouteGuideMock service;
+        ok &= runScenario("streamed unary", options.value(), [&](grpc::ServerBuilder& builder) { builder.RegisterService(&service); });
+    }
+    if (scenario == "generic" || scenario == "all") {
+        MockGenericService service;
+        ok &= runScenario("generic", options.value(), [&](grpc::ServerBuilder& builder) { builder.RegisterCallbackGenericService(&service); });
+    }
+
+    callLog().flush();
+    std::cout << "logged calls: " << logged_call_count << ", dropped: " << callLog().droppedCount() << std::endl;
+    printStages();
+    std::filesystem::remove_all(directory);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+
+#include <grpc_mock_server_binary_mock.h>
+#include <grpc_mock_server_fs_utils.h>
+
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/util/json_util.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+int main(int argc, char* argv[]) {
+    if (argc != 4 && argc != 5) {
+        std::cerr << "usage: " << argv[0] << " <descriptor set file> <full message type> <JSON response file> [<binary response file>]" << std::endl;
+        return 1;
+    }
+
+    google::protobuf::FileDescriptorSet descriptor_set;
+    std::ifstream descriptor_stream(argv[1], std::ios::binary);
+    if (!descriptor_set.ParseFromIstream(&descriptor_stream)) {
+        std::cerr << "ERROR: unable to read descriptor set " << argv[1] << std::endl;
+        return 1;
+    }
+
+    // Dependencies precede the files importing them when the set is built with --include_imports
+    google::protobuf::DescriptorPool pool;
+    for (const auto& file : descriptor_set.file()) {
+        if (pool.BuildFile(file) == nullptr) {
+            std::cerr << "ERROR: unable to build " << file.name() << std::endl;
+            return 1;
+        }
+    }
+
+    auto descriptor = pool.FindMessageTypeByName(argv[2]);
+    if (descriptor == nullptr) {
+        std::cerr << "ERROR: unknown message type " << argv[2] << std::endl;
+        return 1;
+    }
+    google::protobuf::DynamicMessageFactory factory(&pool);
+    std::unique_ptr<google::protobuf::Message> message(factory.GetPrototype(descriptor)->New());
+
+    std::filesystem::path input_path = argv[3];
+    auto input_file = MappedFile::open(input_path);
+    if (!input_file.has_value()) {
+        std::cerr << "ERROR: unable to read " << input_path.string() << std::endl;
+        return 1;
+    }
+    auto input_data = input_file->view();
+    auto status = google::protobuf::util::JsonStringToMessage(
+        google::protobuf::StringPiece(input_data.data(), input_data.size()),
+        message.get()
+    );
+    if (!status.ok()) {
+        std::cerr << "ERROR: invalid response file " << input_path.string() << ": " << status.message() << std::endl;
+        return 1;
+    }
+
+    auto output_path = argc == 5 ? std::filesystem::path(argv[4]) : std::filesystem::path(input_path).replace_extension(grpc_mock_server::kBinaryMockExtension);
+    std::ofstream output(output_path, std::ios::binary | std::ios::trunc);
+    if (!output || !grpc_mock_server::writeBinaryMock(output, { message.get() })) {
+        std::cerr << "ERROR: unable to write " << output_path.string() << std::endl;
+        return 1;
+    }
+    return 0;
+}
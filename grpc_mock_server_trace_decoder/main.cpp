@@ -0,0 +1,56 @@
+/*
+ *
+ * Copyright 2018 gRPC authors, 2022 Aleksandr Kamyshnikov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include <grpc_mock_server_trace_recorder.h>
+
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/dynamic_message.h>
+
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <trace file> <descriptor set file>" << std::endl;
+        return 1;
+    }
+
+    google::protobuf::FileDescriptorSet descriptor_set;
+    std::ifstream descriptor_stream(argv[2], std::ios::binary);
+    if (!descriptor_set.ParseFromIstream(&descriptor_stream)) {
+        std::cerr << "ERROR: unable to read descriptor set " << argv[2] << std::endl;
+        return 1;
+    }
+
+    // Dependencies precede the files importing them when the set is built with --include_imports
+    google::protobuf::DescriptorPool pool;
+    for (const auto& file : descriptor_set.file()) {
+        if (pool.BuildFile(file) == nullptr) {
+            std::cerr << "ERROR: unable to build " << file.name() << std::endl;
+            return 1;
+        }
+    }
+
+    google::protobuf::DynamicMessageFactory factory(&pool);
+    if (!grpc_mock_server::decodeTrace(argv[1], pool, factory, std::cout)) {
+        std::cerr << "ERROR: " << argv[1] << " is not a trace file" << std::endl;
+        return 1;
+    }
+    return 0;
+}